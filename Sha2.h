@@ -26,373 +26,1805 @@
 #define SHA2_H
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if !defined(SHA2CPP_NO_INTRINSICS) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define SHA2CPP_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// The ARMv8 kernels are opt-in (SHA2CPP_ARM_KERNELS) until they have been verified on aarch64 hardware.
+// Older Clang releases only declare the Sha2 intrinsics when the whole file is built for them
+#if !defined(SHA2CPP_NO_INTRINSICS) && defined(SHA2CPP_ARM_KERNELS) && defined(__aarch64__)                      \
+    && ((defined(__GNUC__) && !defined(__clang__)) || (defined(__clang__) && __clang_major__ >= 16)                \
+        || (defined(__ARM_FEATURE_SHA2) && defined(__ARM_FEATURE_SHA512)))
+#define SHA2CPP_ARM
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHA2CPP_TARGET(features) __attribute__((target(features)))
+#define SHA2CPP_INLINE inline __attribute__((always_inline))
+#else
+#define SHA2CPP_TARGET(features)
+#define SHA2CPP_INLINE inline
+#endif
+
+// GCC and Clang spell the AArch64 extensions differently, the Sha512 instructions come with "sha3"
+#ifdef SHA2CPP_ARM
+#if defined(__clang__)
+#define SHA2CPP_TARGET_ARM_SHA2 SHA2CPP_TARGET("sha2")
+#define SHA2CPP_TARGET_ARM_SHA512 SHA2CPP_TARGET("sha3")
+#else
+#define SHA2CPP_TARGET_ARM_SHA2 SHA2CPP_TARGET("+crypto")
+#define SHA2CPP_TARGET_ARM_SHA512 SHA2CPP_TARGET("arch=armv8.2-a+sha3")
+#endif
+#endif
+
+// C++17 lifts the constexpr restrictions far enough to run the portable kernels at compile time
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define SHA2CPP_CONSTEXPR_HASH
+#define SHA2CPP_CONSTEXPR constexpr
+#include <string_view>
+#else
+#define SHA2CPP_CONSTEXPR inline
+#endif
+
+// the multi-buffer engine is written with the GCC/Clang vector extensions
+#if defined(SHA2CPP_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SHA2CPP_MULTI_BUFFER
+#endif
+
 #define SR(word, bits) ((word) >> (bits))
 #define RL(word, bits) (((word) << (bits)) | ((word) >> (32 - (bits))))
 #define RR(word, bits) (((word) >> (bits)) | ((word) << (32 - (bits))))
 #define RL64(word, bits) (((word) << (bits)) | ((word) >> (64 - (bits))))
 #define RR64(word, bits) (((word) >> (bits)) | ((word) << (64 - (bits))))
 
+// one compression round with rotated working variables, the schedule word
+// for round i is expanded in place into the 16 word circular buffer W
+#define SHA2_ROUND(a, b, c, d, e, f, g, h, i)                                                                      \
+    do                                                                                                             \
+    {                                                                                                              \
+        auto t1 = h + sum1(e) + (g ^ (e & (f ^ g))) + K[i] + W[(i) & 15];                                          \
+        d += t1;                                                                                                   \
+        h = t1 + sum0(a) + ((a & b) | (c & (a | b)));                                                              \
+    } while(0)
+#define SHA2_SCHEDULE(i) (W[(i) & 15] += sigma1(W[((i) - 2) & 15]) + W[((i) - 7) & 15] + sigma0(W[((i) - 15) & 15]))
+#define SHA2_ROUNDS8(i)                                                                                            \
+    SHA2_ROUND(a, b, c, d, e, f, g, h, (i) + 0);                                                                   \
+    SHA2_ROUND(h, a, b, c, d, e, f, g, (i) + 1);                                                                   \
+    SHA2_ROUND(g, h, a, b, c, d, e, f, (i) + 2);                                                                   \
+    SHA2_ROUND(f, g, h, a, b, c, d, e, (i) + 3);                                                                   \
+    SHA2_ROUND(e, f, g, h, a, b, c, d, (i) + 4);                                                                   \
+    SHA2_ROUND(d, e, f, g, h, a, b, c, (i) + 5);                                                                   \
+    SHA2_ROUND(c, d, e, f, g, h, a, b, (i) + 6);                                                                   \
+    SHA2_ROUND(b, c, d, e, f, g, h, a, (i) + 7)
+#define SHA2_SCHEDULE8(i)                                                                                          \
+    SHA2_SCHEDULE((i) + 0);                                                                                        \
+    SHA2_SCHEDULE((i) + 1);                                                                                        \
+    SHA2_SCHEDULE((i) + 2);                                                                                        \
+    SHA2_SCHEDULE((i) + 3);                                                                                        \
+    SHA2_SCHEDULE((i) + 4);                                                                                        \
+    SHA2_SCHEDULE((i) + 5);                                                                                        \
+    SHA2_SCHEDULE((i) + 6);                                                                                        \
+    SHA2_SCHEDULE((i) + 7)
+
 namespace Sha2Cpp {
 
 enum class HashType { Sha256, Sha224, Sha512, Sha384, Sha512_256, Sha512_224 };
 
-template <HashType T> class Sha2Base;
+// Non-owning view of contiguous bytes, accepts a pointer with a length, a C string
+// or any container with data() and size() of byte sized elements (std::string,
+// std::vector<uint8_t>, std::array, std::string_view, std::span ...)
+class ByteView {
+public:
+    ByteView() : ptr(nullptr), length(0) {}
+    ByteView(const void *data, size_t size) : ptr(static_cast<const uint8_t *>(data)), length(size) {}
+    ByteView(const char *str) : ptr(reinterpret_cast<const uint8_t *>(str)), length(std::strlen(str)) {}
+
+    template <typename C,
+              typename = typename std::enable_if<sizeof(*std::declval<const C &>().data()) == 1
+                                                 && std::is_integral<decltype(std::declval<const C &>().size())>::value>::type>
+    ByteView(const C &container)
+        : ptr(reinterpret_cast<const uint8_t *>(container.data())), length(container.size())
+    {
+    }
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+    const uint8_t *begin() const { return ptr; }
+    const uint8_t *end() const { return ptr + length; }
+
+private:
+    const uint8_t *ptr;
+    size_t length;
+};
+
+// Compares two byte strings in time that depends only on their lengths, never on
+// where they differ, use it to check MACs and other secrets
+inline bool ConstantTimeEqual(ByteView a, ByteView b)
+{
+    if(a.size() != b.size())
+    {
+        return false;
+    }
+
+    volatile uint8_t diff = 0;
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        diff = diff | (a.data()[i] ^ b.data()[i]);
+    }
+    return diff == 0;
+}
+
+// CPU extensions detected at startup, a hardware backend is used only if its flag is set.
+// The flags are read once per top level call (Update(), Final(), HashMany() ...)
+struct CpuFeatures {
+    bool x86Sha = false;
+    bool avx2 = false;
+    bool avx512 = false;
+    bool armSha2 = false;
+    bool armSha512 = false;
+
+    static const CpuFeatures &Get() { return Active(); }
+
+    // Test and benchmark hook: turns off the extensions whose flag is cleared in features, which
+    // forces the portable code path. It can only turn off what Detect() found, a flag set for an
+    // extension the CPU lacks is ignored. Not synchronized: call it before any hashing starts or
+    // while nothing hashes on any thread (tasks submitted to a ThreadPool afterwards see the change)
+    static void Override(const CpuFeatures &features)
+    {
+        const CpuFeatures &detected = Detected();
+        CpuFeatures &active = Active();
+        active.x86Sha = features.x86Sha && detected.x86Sha;
+        active.avx2 = features.avx2 && detected.avx2;
+        active.avx512 = features.avx512 && detected.avx512;
+        active.armSha2 = features.armSha2 && detected.armSha2;
+        active.armSha512 = features.armSha512 && detected.armSha512;
+    }
+
+    static CpuFeatures Detect()
+    {
+        CpuFeatures features;
+#ifdef SHA2CPP_X86
+        uint32_t leaf1[4] = {};
+        uint32_t leaf7[4] = {};
+        cpuid(0, leaf1);
+        uint32_t maxLeaf = leaf1[0];
+        cpuid(1, leaf1);
+        if(maxLeaf >= 7)
+        {
+            cpuid(7, leaf7);
+        }
+
+        bool ssse3 = (leaf1[2] & (1u << 9)) != 0;
+        bool sse41 = (leaf1[2] & (1u << 19)) != 0;
+        features.x86Sha = ssse3 && sse41 && (leaf7[1] & (1u << 29)) != 0;
+
+        // the wide registers are usable only if the OS saves them on context switches
+        uint64_t xcr0 = (leaf1[2] & (1u << 27)) != 0 ? xgetbv() : 0;
+        bool avxState = (xcr0 & 0x06) == 0x06;
+        bool avx512State = (xcr0 & 0xE6) == 0xE6;
+        features.avx2 = avxState && (leaf7[1] & (1u << 5)) != 0;
+        features.avx512 = avx512State && (leaf7[1] & (1u << 16)) != 0;
+#endif
+#if defined(SHA2CPP_ARM) && defined(__linux__)
+        unsigned long hwcap = getauxval(AT_HWCAP);
+        features.armSha2 = (hwcap & (1ul << 6)) != 0;    // HWCAP_SHA2
+        features.armSha512 = (hwcap & (1ul << 21)) != 0; // HWCAP_SHA512
+#elif defined(SHA2CPP_ARM) && defined(__APPLE__)
+        // every Apple arm64 core has the Sha256 instructions, Sha512 is reported by the kernel
+        int sha512 = 0;
+        size_t size = sizeof(sha512);
+        features.armSha2 = true;
+        features.armSha512 = sysctlbyname("hw.optional.armv8_2_sha512", &sha512, &size, nullptr, 0) == 0 && sha512 != 0;
+#endif
+        return features;
+    }
+
+private:
+    static const CpuFeatures &Detected()
+    {
+        static const CpuFeatures features = Detect();
+        return features;
+    }
+
+    static CpuFeatures &Active()
+    {
+        static CpuFeatures features = Detected();
+        return features;
+    }
+
+#ifdef SHA2CPP_X86
+    static void cpuid(uint32_t leaf, uint32_t regs[4])
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, static_cast<int>(leaf), 0);
+        for(size_t i = 0; i < 4; i++)
+        {
+            regs[i] = static_cast<uint32_t>(info[i]);
+        }
+#else
+        __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    static uint64_t xgetbv()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+#endif
+};
+
+#ifdef SHA2CPP_X86
+namespace detail {
 
-class Sha32Data {
+// Sha256 block compression with the x86 SHA extensions, the state is kept as the ABEF/CDGH
+// register pair sha256rnds2 expects and each group of four rounds consumes one schedule
+// register while the next one is expanded with sha256msg1/sha256msg2
+#define SHA2_SHANI_ROUNDS(k, Mi)                                                                                   \
+    MSG = _mm_add_epi32(Mi, _mm_loadu_si128(reinterpret_cast<const __m128i *>(K + (k))));                          \
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG)
+#define SHA2_SHANI_ROUNDS_END()                                                                                    \
+    MSG = _mm_shuffle_epi32(MSG, 0x0E);                                                                            \
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG)
+#define SHA2_SHANI_EXPAND(Mi, Mprev, Mnext)                                                                        \
+    Mnext = _mm_add_epi32(Mnext, _mm_alignr_epi8(Mi, Mprev, 4));                                                   \
+    Mnext = _mm_sha256msg2_epu32(Mnext, Mi)
+#define SHA2_SHANI_GROUP(k, Mi, Mprev, Mnext)                                                                      \
+    SHA2_SHANI_ROUNDS(k, Mi);                                                                                      \
+    SHA2_SHANI_EXPAND(Mi, Mprev, Mnext);                                                                           \
+    SHA2_SHANI_ROUNDS_END();                                                                                       \
+    Mprev = _mm_sha256msg1_epu32(Mprev, Mi)
+
+SHA2CPP_TARGET("sha,sse4.1")
+inline void CompressBlocksShaNi(uint32_t *state, const uint8_t *blocks, size_t nblocks, const uint32_t *K)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i STATE0, STATE1, MSG, TMP, MSG0, MSG1, MSG2, MSG3;
+
+    TMP = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+    STATE1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+    TMP = _mm_shuffle_epi32(TMP, 0xB1);          // CDAB
+    STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);    // EFGH
+    STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);    // ABEF
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0); // CDGH
+
+    for(; nblocks > 0; nblocks--, blocks += 64)
+    {
+        __m128i ABEF_SAVE = STATE0;
+        __m128i CDGH_SAVE = STATE1;
+
+        MSG0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks)), MASK);
+        MSG1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 16)), MASK);
+        MSG2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 32)), MASK);
+        MSG3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + 48)), MASK);
+
+        SHA2_SHANI_ROUNDS(0, MSG0);
+        SHA2_SHANI_ROUNDS_END();
+
+        SHA2_SHANI_ROUNDS(4, MSG1);
+        SHA2_SHANI_ROUNDS_END();
+        MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+        SHA2_SHANI_ROUNDS(8, MSG2);
+        SHA2_SHANI_ROUNDS_END();
+        MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+        SHA2_SHANI_GROUP(12, MSG3, MSG2, MSG0);
+        SHA2_SHANI_GROUP(16, MSG0, MSG3, MSG1);
+        SHA2_SHANI_GROUP(20, MSG1, MSG0, MSG2);
+        SHA2_SHANI_GROUP(24, MSG2, MSG1, MSG3);
+        SHA2_SHANI_GROUP(28, MSG3, MSG2, MSG0);
+        SHA2_SHANI_GROUP(32, MSG0, MSG3, MSG1);
+        SHA2_SHANI_GROUP(36, MSG1, MSG0, MSG2);
+        SHA2_SHANI_GROUP(40, MSG2, MSG1, MSG3);
+        SHA2_SHANI_GROUP(44, MSG3, MSG2, MSG0);
+        SHA2_SHANI_GROUP(48, MSG0, MSG3, MSG1);
+
+        SHA2_SHANI_ROUNDS(52, MSG1);
+        SHA2_SHANI_EXPAND(MSG1, MSG0, MSG2);
+        SHA2_SHANI_ROUNDS_END();
+
+        SHA2_SHANI_ROUNDS(56, MSG2);
+        SHA2_SHANI_EXPAND(MSG2, MSG1, MSG3);
+        SHA2_SHANI_ROUNDS_END();
+
+        SHA2_SHANI_ROUNDS(60, MSG3);
+        SHA2_SHANI_ROUNDS_END();
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);       // FEBA
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);    // DCHG
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0); // DCBA
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);    // HGFE
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), STATE0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), STATE1);
+}
+
+} // namespace detail
+#endif
+
+#ifdef SHA2CPP_ARM
+namespace detail {
+
+// Sha256 block compression with the ARMv8 Crypto Extensions. The state stays in the ABCD/EFGH
+// order sha256h/sha256h2 expect, each group of four rounds consumes one schedule register and
+// replaces it with the words sixteen rounds ahead (sha256su0/sha256su1)
+#define SHA2_ARM256_ROUNDS(k, Mi)                                                                                  \
+    WK = vaddq_u32(Mi, vld1q_u32(K + (k)));                                                                        \
+    ABCD = STATE0;                                                                                                 \
+    STATE0 = vsha256hq_u32(STATE0, STATE1, WK);                                                                    \
+    STATE1 = vsha256h2q_u32(STATE1, ABCD, WK)
+#define SHA2_ARM256_GROUP(k, M0, M1, M2, M3)                                                                       \
+    SHA2_ARM256_ROUNDS(k, M0);                                                                                     \
+    M0 = vsha256su1q_u32(vsha256su0q_u32(M0, M1), M2, M3)
+
+SHA2CPP_TARGET_ARM_SHA2
+inline void CompressBlocksArmSha256(uint32_t *state, const uint8_t *blocks, size_t nblocks, const uint32_t *K)
+{
+    uint32x4_t STATE0 = vld1q_u32(state);
+    uint32x4_t STATE1 = vld1q_u32(state + 4);
+    uint32x4_t WK, ABCD, MSG0, MSG1, MSG2, MSG3;
+
+    for(; nblocks > 0; nblocks--, blocks += 64)
+    {
+        uint32x4_t ABCD_SAVE = STATE0;
+        uint32x4_t EFGH_SAVE = STATE1;
+
+        MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks)));
+        MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16)));
+        MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 32)));
+        MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 48)));
+
+        for(size_t k = 0; k < 48; k += 16)
+        {
+            SHA2_ARM256_GROUP(k, MSG0, MSG1, MSG2, MSG3);
+            SHA2_ARM256_GROUP(k + 4, MSG1, MSG2, MSG3, MSG0);
+            SHA2_ARM256_GROUP(k + 8, MSG2, MSG3, MSG0, MSG1);
+            SHA2_ARM256_GROUP(k + 12, MSG3, MSG0, MSG1, MSG2);
+        }
+        SHA2_ARM256_ROUNDS(48, MSG0);
+        SHA2_ARM256_ROUNDS(52, MSG1);
+        SHA2_ARM256_ROUNDS(56, MSG2);
+        SHA2_ARM256_ROUNDS(60, MSG3);
+
+        STATE0 = vaddq_u32(STATE0, ABCD_SAVE);
+        STATE1 = vaddq_u32(STATE1, EFGH_SAVE);
+    }
+
+    vst1q_u32(state, STATE0);
+    vst1q_u32(state + 4, STATE1);
+}
+
+// Sha512 block compression with the ARMv8.2 Sha512 instructions. Every sha512h/sha512h2 pair runs
+// two rounds and leaves the state rotated by one register: the new AB lands in the old GH register
+// and the new EF in the old CD one, so the callers rotate the register names instead of moving data
+#define SHA2_ARM512_ROUNDS(k, Mi, AB, CD, EF, GH)                                                                  \
+    WK = vaddq_u64(Mi, vld1q_u64(K + (k)));                                                                        \
+    WK = vaddq_u64(vextq_u64(WK, WK, 1), GH);                                                                      \
+    SUM = vsha512hq_u64(WK, vextq_u64(EF, GH, 1), vextq_u64(CD, EF, 1));                                           \
+    GH = vsha512h2q_u64(SUM, CD, AB);                                                                              \
+    CD = vaddq_u64(CD, SUM)
+#define SHA2_ARM512_GROUP(k, M0, M1, M4, M5, M7, AB, CD, EF, GH)                                                   \
+    SHA2_ARM512_ROUNDS(k, M0, AB, CD, EF, GH);                                                                     \
+    M0 = vsha512su1q_u64(vsha512su0q_u64(M0, M1), M7, vextq_u64(M4, M5, 1))
+
+SHA2CPP_TARGET_ARM_SHA512
+inline void CompressBlocksArmSha512(uint64_t *state, const uint8_t *blocks, size_t nblocks, const uint64_t *K)
+{
+    uint64x2_t AB = vld1q_u64(state);
+    uint64x2_t CD = vld1q_u64(state + 2);
+    uint64x2_t EF = vld1q_u64(state + 4);
+    uint64x2_t GH = vld1q_u64(state + 6);
+    uint64x2_t WK, SUM, MSG0, MSG1, MSG2, MSG3, MSG4, MSG5, MSG6, MSG7;
+
+    for(; nblocks > 0; nblocks--, blocks += 128)
+    {
+        uint64x2_t AB_SAVE = AB;
+        uint64x2_t CD_SAVE = CD;
+        uint64x2_t EF_SAVE = EF;
+        uint64x2_t GH_SAVE = GH;
+
+        MSG0 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks)));
+        MSG1 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 16)));
+        MSG2 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 32)));
+        MSG3 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 48)));
+        MSG4 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 64)));
+        MSG5 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 80)));
+        MSG6 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 96)));
+        MSG7 = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(blocks + 112)));
+
+        // eight register rotations bring the names back to AB, CD, EF, GH
+        for(size_t k = 0; k < 64; k += 16)
+        {
+            SHA2_ARM512_GROUP(k, MSG0, MSG1, MSG4, MSG5, MSG7, AB, CD, EF, GH);
+            SHA2_ARM512_GROUP(k + 2, MSG1, MSG2, MSG5, MSG6, MSG0, GH, AB, CD, EF);
+            SHA2_ARM512_GROUP(k + 4, MSG2, MSG3, MSG6, MSG7, MSG1, EF, GH, AB, CD);
+            SHA2_ARM512_GROUP(k + 6, MSG3, MSG4, MSG7, MSG0, MSG2, CD, EF, GH, AB);
+            SHA2_ARM512_GROUP(k + 8, MSG4, MSG5, MSG0, MSG1, MSG3, AB, CD, EF, GH);
+            SHA2_ARM512_GROUP(k + 10, MSG5, MSG6, MSG1, MSG2, MSG4, GH, AB, CD, EF);
+            SHA2_ARM512_GROUP(k + 12, MSG6, MSG7, MSG2, MSG3, MSG5, EF, GH, AB, CD);
+            SHA2_ARM512_GROUP(k + 14, MSG7, MSG0, MSG3, MSG4, MSG6, CD, EF, GH, AB);
+        }
+        SHA2_ARM512_ROUNDS(64, MSG0, AB, CD, EF, GH);
+        SHA2_ARM512_ROUNDS(66, MSG1, GH, AB, CD, EF);
+        SHA2_ARM512_ROUNDS(68, MSG2, EF, GH, AB, CD);
+        SHA2_ARM512_ROUNDS(70, MSG3, CD, EF, GH, AB);
+        SHA2_ARM512_ROUNDS(72, MSG4, AB, CD, EF, GH);
+        SHA2_ARM512_ROUNDS(74, MSG5, GH, AB, CD, EF);
+        SHA2_ARM512_ROUNDS(76, MSG6, EF, GH, AB, CD);
+        SHA2_ARM512_ROUNDS(78, MSG7, CD, EF, GH, AB);
+
+        AB = vaddq_u64(AB, AB_SAVE);
+        CD = vaddq_u64(CD, CD_SAVE);
+        EF = vaddq_u64(EF, EF_SAVE);
+        GH = vaddq_u64(GH, GH_SAVE);
+    }
+
+    vst1q_u64(state, AB);
+    vst1q_u64(state + 2, CD);
+    vst1q_u64(state + 4, EF);
+    vst1q_u64(state + 6, GH);
+}
+
+} // namespace detail
+#endif
+
+// Sha2Base and the data classes are templates only so that their static tables can be
+// defined in this header without C++17 inline variables
+template <HashType T, typename = void> class Sha2Base;
+
+template <typename Dummy = void> class Sha32Data {
 protected:
-    const uint32_t K[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
-                            0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
-                            0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
-                            0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-                            0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
-                            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
-                            0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
-                            0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-                            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
-                            0xc67178f2};
-
-    uint32_t sigma0(uint32_t wj) { return RR(wj, 7) ^ RR(wj, 18) ^ SR(wj, 3); }
-    uint32_t sigma1(uint32_t wj) { return RR(wj, 17) ^ RR(wj, 19) ^ SR(wj, 10); }
-    uint32_t sum1(uint32_t e) { return RR(e, 6) ^ RR(e, 11) ^ RR(e, 25); }
-    uint32_t sum0(uint32_t a) { return RR(a, 2) ^ RR(a, 13) ^ RR(a, 22); }
+    static constexpr uint32_t K[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+                                       0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+                                       0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+                                       0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                                       0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+                                       0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+                                       0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+                                       0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                                       0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+                                       0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+                                       0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    static constexpr uint32_t sigma0(uint32_t wj) { return RR(wj, 7) ^ RR(wj, 18) ^ SR(wj, 3); }
+    static constexpr uint32_t sigma1(uint32_t wj) { return RR(wj, 17) ^ RR(wj, 19) ^ SR(wj, 10); }
+    static constexpr uint32_t sum1(uint32_t e) { return RR(e, 6) ^ RR(e, 11) ^ RR(e, 25); }
+    static constexpr uint32_t sum0(uint32_t a) { return RR(a, 2) ^ RR(a, 13) ^ RR(a, 22); }
+
+    static constexpr uint32_t load(const uint8_t *p)
+    {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+               | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+
+    using Compress = void (*)(uint32_t *state, const uint8_t *blocks, size_t nblocks);
+
+    // block compression backend for the active CpuFeatures
+    static Compress CompressKernel()
+    {
+        const CpuFeatures &features = CpuFeatures::Get();
+        (void)features;
+#ifdef SHA2CPP_X86
+        if(features.x86Sha)
+        {
+            return &CompressBlocksShaNi;
+        }
+#endif
+#ifdef SHA2CPP_ARM
+        if(features.armSha2)
+        {
+            return &CompressBlocksArm;
+        }
+#endif
+        return &CompressBlocksPortable;
+    }
+
+#ifdef SHA2CPP_X86
+    static void CompressBlocksShaNi(uint32_t *state, const uint8_t *blocks, size_t nblocks)
+    {
+        detail::CompressBlocksShaNi(state, blocks, nblocks, K);
+    }
+#endif
+#ifdef SHA2CPP_ARM
+    static void CompressBlocksArm(uint32_t *state, const uint8_t *blocks, size_t nblocks)
+    {
+        detail::CompressBlocksArmSha256(state, blocks, nblocks, K);
+    }
+#endif
+
+    static SHA2CPP_CONSTEXPR void CompressBlocksPortable(uint32_t *state, const uint8_t *blocks, size_t nblocks)
+    {
+        uint32_t W[16] = {};
+
+        for(; nblocks > 0; nblocks--, blocks += 64)
+        {
+            for(size_t i = 0; i < 16; i++)
+            {
+                W[i] = load(blocks + i * 4);
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+            SHA2_ROUNDS8(0);
+            SHA2_ROUNDS8(8);
+            for(size_t i = 16; i < 64; i += 16)
+            {
+                SHA2_SCHEDULE8(i);
+                SHA2_ROUNDS8(i);
+                SHA2_SCHEDULE8(i + 8);
+                SHA2_ROUNDS8(i + 8);
+            }
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+    }
 };
 
+template <typename Dummy> constexpr uint32_t Sha32Data<Dummy>::K[64];
+
 #ifdef WITH_SHA256
-template <> class Sha2Base<HashType::Sha256> : public Sha32Data {
+template <typename Dummy> class Sha2Base<HashType::Sha256, Dummy> : public Sha32Data<Dummy> {
 protected:
     using BaseType = uint32_t;
     constexpr static size_t BlockSize = 64;
     constexpr static size_t RoundCount = 64;
     constexpr static size_t ResultBytes = 32;
 
-    const BaseType H[8]
+    static constexpr BaseType H[8]
         = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
 };
+
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha256, Dummy>::BaseType Sha2Base<HashType::Sha256, Dummy>::H[8];
 #endif
 
 #ifdef WITH_SHA224
-template <> class Sha2Base<HashType::Sha224> : public Sha32Data {
+template <typename Dummy> class Sha2Base<HashType::Sha224, Dummy> : public Sha32Data<Dummy> {
 protected:
     using BaseType = uint32_t;
     constexpr static size_t BlockSize = 64;
     constexpr static size_t RoundCount = 64;
     constexpr static size_t ResultBytes = 28;
 
-    const BaseType H[8]
+    static constexpr BaseType H[8]
         = {0xc1059ed8, 0x367cd507, 0x3070dd17, 0xf70e5939, 0xffc00b31, 0x68581511, 0x64f98fa7, 0xbefa4fa4};
 };
+
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha224, Dummy>::BaseType Sha2Base<HashType::Sha224, Dummy>::H[8];
 #endif
 
-class Sha64Data {
+template <typename Dummy = void> class Sha64Data {
 protected:
-    const uint64_t K[128] = {0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
-                             0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
-                             0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
-                             0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
-                             0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
-                             0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
-                             0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
-                             0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
-                             0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
-                             0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
-                             0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
-                             0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
-                             0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
-                             0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
-                             0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
-                             0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
-                             0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
-                             0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
-                             0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
-                             0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817};
-
-    uint64_t sigma0(uint64_t wj) { return RR64(wj, 1) ^ RR64(wj, 8) ^ SR(wj, 7); }
-    uint64_t sigma1(uint64_t wj) { return RR64(wj, 19) ^ RR64(wj, 61) ^ SR(wj, 6); }
-    uint64_t sum1(uint64_t e) { return RR64(e, 14) ^ RR64(e, 18) ^ RR64(e, 41); }
-    uint64_t sum0(uint64_t a) { return RR64(a, 28) ^ RR64(a, 34) ^ RR64(a, 39); }
+    static constexpr uint64_t K[128] = {0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+                                        0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+                                        0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+                                        0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+                                        0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+                                        0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+                                        0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+                                        0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+                                        0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+                                        0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+                                        0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+                                        0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+                                        0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+                                        0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+                                        0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+                                        0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+                                        0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+                                        0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+                                        0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+                                        0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817};
+
+    static constexpr uint64_t sigma0(uint64_t wj) { return RR64(wj, 1) ^ RR64(wj, 8) ^ SR(wj, 7); }
+    static constexpr uint64_t sigma1(uint64_t wj) { return RR64(wj, 19) ^ RR64(wj, 61) ^ SR(wj, 6); }
+    static constexpr uint64_t sum1(uint64_t e) { return RR64(e, 14) ^ RR64(e, 18) ^ RR64(e, 41); }
+    static constexpr uint64_t sum0(uint64_t a) { return RR64(a, 28) ^ RR64(a, 34) ^ RR64(a, 39); }
+
+    static constexpr uint64_t load(const uint8_t *p)
+    {
+        return (static_cast<uint64_t>(p[0]) << 56) | (static_cast<uint64_t>(p[1]) << 48)
+               | (static_cast<uint64_t>(p[2]) << 40) | (static_cast<uint64_t>(p[3]) << 32)
+               | (static_cast<uint64_t>(p[4]) << 24) | (static_cast<uint64_t>(p[5]) << 16)
+               | (static_cast<uint64_t>(p[6]) << 8) | static_cast<uint64_t>(p[7]);
+    }
+
+    using Compress = void (*)(uint64_t *state, const uint8_t *blocks, size_t nblocks);
+
+    // block compression backend for the active CpuFeatures
+    static Compress CompressKernel()
+    {
+#ifdef SHA2CPP_ARM
+        if(CpuFeatures::Get().armSha512)
+        {
+            return &CompressBlocksArm;
+        }
+#endif
+        return &CompressBlocksPortable;
+    }
+
+#ifdef SHA2CPP_ARM
+    static void CompressBlocksArm(uint64_t *state, const uint8_t *blocks, size_t nblocks)
+    {
+        detail::CompressBlocksArmSha512(state, blocks, nblocks, K);
+    }
+#endif
+
+    static SHA2CPP_CONSTEXPR void CompressBlocksPortable(uint64_t *state, const uint8_t *blocks, size_t nblocks)
+    {
+        uint64_t W[16] = {};
+
+        for(; nblocks > 0; nblocks--, blocks += 128)
+        {
+            for(size_t i = 0; i < 16; i++)
+            {
+                W[i] = load(blocks + i * 8);
+            }
+
+            uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+            SHA2_ROUNDS8(0);
+            SHA2_ROUNDS8(8);
+            for(size_t i = 16; i < 80; i += 16)
+            {
+                SHA2_SCHEDULE8(i);
+                SHA2_ROUNDS8(i);
+                SHA2_SCHEDULE8(i + 8);
+                SHA2_ROUNDS8(i + 8);
+            }
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+    }
 };
 
+template <typename Dummy> constexpr uint64_t Sha64Data<Dummy>::K[128];
+
 #ifdef WITH_SHA512
-template <> class Sha2Base<HashType::Sha512> : public Sha64Data {
+template <typename Dummy> class Sha2Base<HashType::Sha512, Dummy> : public Sha64Data<Dummy> {
 protected:
     using BaseType = uint64_t;
     constexpr static size_t BlockSize = 128;
     constexpr static size_t RoundCount = 80;
     constexpr static size_t ResultBytes = 64;
 
-    const BaseType H[8] = {0x6a09e667f3bcc908,
-                           0xbb67ae8584caa73b,
-                           0x3c6ef372fe94f82b,
-                           0xa54ff53a5f1d36f1,
-                           0x510e527fade682d1,
-                           0x9b05688c2b3e6c1f,
-                           0x1f83d9abfb41bd6b,
-                           0x5be0cd19137e2179};
+    static constexpr BaseType H[8] = {0x6a09e667f3bcc908,
+                                      0xbb67ae8584caa73b,
+                                      0x3c6ef372fe94f82b,
+                                      0xa54ff53a5f1d36f1,
+                                      0x510e527fade682d1,
+                                      0x9b05688c2b3e6c1f,
+                                      0x1f83d9abfb41bd6b,
+                                      0x5be0cd19137e2179};
 };
 
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha512, Dummy>::BaseType Sha2Base<HashType::Sha512, Dummy>::H[8];
+
 #endif
 
 #ifdef WITH_SHA384
-template <> class Sha2Base<HashType::Sha384> : public Sha64Data {
+template <typename Dummy> class Sha2Base<HashType::Sha384, Dummy> : public Sha64Data<Dummy> {
 protected:
     using BaseType = uint64_t;
     constexpr static size_t BlockSize = 128;
     constexpr static size_t RoundCount = 80;
     constexpr static size_t ResultBytes = 48;
 
-    const BaseType H[8] = {0xcbbb9d5dc1059ed8,
-                           0x629a292a367cd507,
-                           0x9159015a3070dd17,
-                           0x152fecd8f70e5939,
-                           0x67332667ffc00b31,
-                           0x8eb44a8768581511,
-                           0xdb0c2e0d64f98fa7,
-                           0x47b5481dbefa4fa4};
+    static constexpr BaseType H[8] = {0xcbbb9d5dc1059ed8,
+                                      0x629a292a367cd507,
+                                      0x9159015a3070dd17,
+                                      0x152fecd8f70e5939,
+                                      0x67332667ffc00b31,
+                                      0x8eb44a8768581511,
+                                      0xdb0c2e0d64f98fa7,
+                                      0x47b5481dbefa4fa4};
 };
+
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha384, Dummy>::BaseType Sha2Base<HashType::Sha384, Dummy>::H[8];
 #endif
 
 #ifdef WITH_SHA512_256
-template <> class Sha2Base<HashType::Sha512_256> : public Sha64Data {
+template <typename Dummy> class Sha2Base<HashType::Sha512_256, Dummy> : public Sha64Data<Dummy> {
 protected:
     using BaseType = uint64_t;
     constexpr static size_t BlockSize = 128;
     constexpr static size_t RoundCount = 80;
     constexpr static size_t ResultBytes = 32;
 
-    const BaseType H[8] = {0x22312194FC2BF72C,
-                           0x9F555FA3C84C64C2,
-                           0x2393B86B6F53B151,
-                           0x963877195940EABD,
-                           0x96283EE2A88EFFE3,
-                           0xBE5E1E2553863992,
-                           0x2B0199FC2C85B8AA,
-                           0x0EB72DDC81C52CA2};
+    static constexpr BaseType H[8] = {0x22312194FC2BF72C,
+                                      0x9F555FA3C84C64C2,
+                                      0x2393B86B6F53B151,
+                                      0x963877195940EABD,
+                                      0x96283EE2A88EFFE3,
+                                      0xBE5E1E2553863992,
+                                      0x2B0199FC2C85B8AA,
+                                      0x0EB72DDC81C52CA2};
 };
+
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha512_256, Dummy>::BaseType Sha2Base<HashType::Sha512_256, Dummy>::H[8];
 #endif
 
 #ifdef WITH_SHA512_224
-template <> class Sha2Base<HashType::Sha512_224> : public Sha64Data {
+template <typename Dummy> class Sha2Base<HashType::Sha512_224, Dummy> : public Sha64Data<Dummy> {
 protected:
     using BaseType = uint64_t;
     constexpr static size_t BlockSize = 128;
     constexpr static size_t RoundCount = 80;
     constexpr static size_t ResultBytes = 28;
 
-    const BaseType H[8] = {0x8C3D37C819544DA2,
-                           0x73E1996689DCD4D6,
-                           0x1DFAB7AE32FF9C82,
-                           0x679DD514582F9FCF,
-                           0x0F6D2B697BD44DA8,
-                           0x77E36F7304C48942,
-                           0x3F9D85A86A1D36C8,
-                           0x1112E6AD91D692A1};
+    static constexpr BaseType H[8] = {0x8C3D37C819544DA2,
+                                      0x73E1996689DCD4D6,
+                                      0x1DFAB7AE32FF9C82,
+                                      0x679DD514582F9FCF,
+                                      0x0F6D2B697BD44DA8,
+                                      0x77E36F7304C48942,
+                                      0x3F9D85A86A1D36C8,
+                                      0x1112E6AD91D692A1};
 };
+
+template <typename Dummy>
+constexpr typename Sha2Base<HashType::Sha512_224, Dummy>::BaseType Sha2Base<HashType::Sha512_224, Dummy>::H[8];
 #endif
 
-template <HashType T> class Sha2 : public Sha2Base<T> {
-public:
-    std::vector<uint8_t> Hash(const std::string &str) { return Hash(std::vector<uint8_t>(str.begin(), str.end())); }
+namespace detail {
 
-    std::vector<uint8_t> Hash(const std::vector<uint8_t> &message)
+template <typename Word> SHA2CPP_INLINE Word LoadBigEndian(const uint8_t *p)
+{
+    Word word = 0;
+    for(size_t i = 0; i < sizeof(Word); i++)
     {
-        if(message.size() & 0xE000000000000000)
-        {
-            // actually the sha512 length can be up to 2^128-1 bits but it seems
-            // logical to me to limit the length to 64 bits (or 61 bytes) in order
-            // to avoid unnecessary conversions anyway, that's still 1048576 TB
-            return {};
-        }
+        word = (word << 8) | p[i];
+    }
+    return word;
+}
 
-        // messageLength + 8 + padLength + sizeBlockLength = BlockSize
-        uint64_t messageLength = message.size() * 8;
-        const size_t sizeBlockLength = BaseTypeSize * 2;
-        BaseType padLength = ((BlockSize - 1 - sizeBlockLength) * 8) - (messageLength % (BlockSize * 8));
+template <size_t... I> struct Indices {};
 
-        std::vector<uint8_t> padding;
-        padding.push_back(0b10000000);
-        // fill with padding zeroes
-        auto pad1 = std::vector<uint8_t>(padLength / 8, 0);
-        padding.insert(padding.end(), pad1.begin(), pad1.end());
+template <size_t Count, size_t... I> struct MakeIndices : MakeIndices<Count - 1, Count - 1, I...> {};
 
-        // copy message length bytes
-        auto pad2 = std::vector<uint8_t>(sizeBlockLength, 0);
-        for(size_t i = 0; i < sizeof(uint64_t); i++)
+template <size_t... I> struct MakeIndices<0, I...> {
+    using Type = Indices<I...>;
+};
+
+// Byte i of the padding blocks of a message whose last block holds tail bytes: 0x80 right
+// after the tail, the bit length in the last eight bytes, zero elsewhere
+constexpr uint8_t FixedPaddingByte(size_t i, size_t tail, size_t size, uint64_t bitLength)
+{
+    return i == tail ? 0b10000000
+                     : (i + sizeof(uint64_t) >= size ? static_cast<uint8_t>(bitLength >> ((size - 1 - i) * 8)) : 0);
+}
+
+// The padding blocks of an N byte message as a constant, bytes [0, Tail) are placeholders
+// for the end of the message. The length field takes LengthBytes, i.e. 8 for Sha224/256
+// and 16 for the Sha512 family
+template <size_t N, size_t BlockSize, size_t LengthBytes,
+          typename = typename MakeIndices<((N % BlockSize + 1 + LengthBytes > BlockSize) ? 2 : 1) * BlockSize>::Type>
+struct FixedPadding;
+
+template <size_t N, size_t BlockSize, size_t LengthBytes, size_t... I>
+struct FixedPadding<N, BlockSize, LengthBytes, Indices<I...>> {
+    static constexpr size_t FullBlocks = N / BlockSize;
+    static constexpr size_t Tail = N % BlockSize;
+    static constexpr size_t Blocks = sizeof...(I) / BlockSize;
+    static constexpr uint8_t Block[sizeof...(I)]
+        = {FixedPaddingByte(I, N % BlockSize, sizeof...(I), static_cast<uint64_t>(N) << 3)...};
+};
+
+template <size_t N, size_t BlockSize, size_t LengthBytes, size_t... I>
+constexpr uint8_t FixedPadding<N, BlockSize, LengthBytes, Indices<I...>>::Block[sizeof...(I)];
+
+#ifdef SHA2CPP_MULTI_BUFFER
+typedef uint32_t V8x32 __attribute__((vector_size(32)));
+typedef uint32_t V16x32 __attribute__((vector_size(64)));
+typedef uint64_t V4x64 __attribute__((vector_size(32)));
+typedef uint64_t V8x64 __attribute__((vector_size(64)));
+
+// Rotation and shift amounts of the round functions, the lane kernel spells the
+// functions out inline so no vector is ever passed to or returned from a function
+// compiled without the wide instruction set
+template <typename Word> struct RoundShifts;
+
+template <> struct RoundShifts<uint32_t> {
+    enum { S0a = 2, S0b = 13, S0c = 22, S1a = 6, S1b = 11, S1c = 25 };
+    enum { s0a = 7, s0b = 18, s0c = 3, s1a = 17, s1b = 19, s1c = 10 };
+};
+
+template <> struct RoundShifts<uint64_t> {
+    enum { S0a = 28, S0b = 34, S0c = 39, S1a = 14, S1b = 18, S1c = 41 };
+    enum { s0a = 1, s0b = 8, s0c = 7, s1a = 19, s1b = 61, s1c = 6 };
+};
+
+#define SHA2_LANE_ROTR(x, bits) (((x) >> static_cast<int>(bits)) | ((x) << static_cast<int>(sizeof(Word) * 8 - (bits))))
+
+// Compresses one block per lane with a vector holding the same word of every lane's
+// state, word i of lane j lives at state[i * Lanes + j]
+template <typename V, typename Word, size_t Lanes, size_t RoundCount> struct LaneKernel {
+    static SHA2CPP_INLINE void Compress(Word *state, const uint8_t *const *blocks, const Word *K)
+    {
+        typedef RoundShifts<Word> R;
+        V W[16];
+        for(size_t i = 0; i < 16; i++)
         {
-            pad2[sizeBlockLength - i - 1] = ((messageLength >> (i * 8)) & 0xFF);
+            Word words[Lanes];
+            for(size_t j = 0; j < Lanes; j++)
+            {
+                words[j] = LoadBigEndian<Word>(blocks[j] + i * sizeof(Word));
+            }
+            std::memcpy(&W[i], words, sizeof(V));
         }
-        padding.insert(padding.end(), pad2.begin(), pad2.end());
-
-        size_t total = message.size() + padding.size();
-        size_t pos = 0;
-        size_t dpos = 0;
 
-        const uint8_t *ptr = message.data();
-        BaseType W[RoundCount] = {};
-        BaseType Hlocal[8];
-        BaseType value[8];
+        V value[8];
+        std::memcpy(value, state, sizeof(value));
+        V a = value[0], b = value[1], c = value[2], d = value[3];
+        V e = value[4], f = value[5], g = value[6], h = value[7];
 
-        for(size_t i = 0; i < 8; i++)
+        for(size_t i = 0; i < RoundCount; i++)
         {
-            Hlocal[i] = H[i];
+            if(i >= 16)
+            {
+                V wi = W[(i - 15) & 15];
+                V wj = W[(i - 2) & 15];
+                W[i & 15] += (SHA2_LANE_ROTR(wj, R::s1a) ^ SHA2_LANE_ROTR(wj, R::s1b) ^ (wj >> static_cast<int>(R::s1c)))
+                             + W[(i - 7) & 15]
+                             + (SHA2_LANE_ROTR(wi, R::s0a) ^ SHA2_LANE_ROTR(wi, R::s0b) ^ (wi >> static_cast<int>(R::s0c)));
+            }
+
+            V s1 = SHA2_LANE_ROTR(e, R::S1a) ^ SHA2_LANE_ROTR(e, R::S1b) ^ SHA2_LANE_ROTR(e, R::S1c);
+            V s0 = SHA2_LANE_ROTR(a, R::S0a) ^ SHA2_LANE_ROTR(a, R::S0b) ^ SHA2_LANE_ROTR(a, R::S0c);
+            V temp1 = h + s1 + (g ^ (e & (f ^ g))) + K[i] + W[i & 15];
+            V temp2 = s0 + ((a & b) | (c & (a | b)));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
         }
 
-        while(pos < total)
+        value[0] += a;
+        value[1] += b;
+        value[2] += c;
+        value[3] += d;
+        value[4] += e;
+        value[5] += f;
+        value[6] += g;
+        value[7] += h;
+        std::memcpy(state, value, sizeof(value));
+    }
+};
+
+SHA2CPP_TARGET("avx2")
+inline void CompressLanesAvx2(uint32_t *state, const uint8_t *const *blocks, const uint32_t *K)
+{
+    LaneKernel<V8x32, uint32_t, 8, 64>::Compress(state, blocks, K);
+}
+
+SHA2CPP_TARGET("avx2")
+inline void CompressLanesAvx2(uint64_t *state, const uint8_t *const *blocks, const uint64_t *K)
+{
+    LaneKernel<V4x64, uint64_t, 4, 80>::Compress(state, blocks, K);
+}
+
+SHA2CPP_TARGET("avx512f")
+inline void CompressLanesAvx512(uint32_t *state, const uint8_t *const *blocks, const uint32_t *K)
+{
+    LaneKernel<V16x32, uint32_t, 16, 64>::Compress(state, blocks, K);
+}
+
+SHA2CPP_TARGET("avx512f")
+inline void CompressLanesAvx512(uint64_t *state, const uint8_t *const *blocks, const uint64_t *K)
+{
+    LaneKernel<V8x64, uint64_t, 8, 80>::Compress(state, blocks, K);
+}
+
+// Feeds independent messages through a lane kernel. Every lane walks the whole blocks
+// of its message in place and then one or two padding blocks built in the lane buffer.
+// A lane that has finished takes the next pending message right away, lanes left
+// without work once the queue is empty are masked out: they compress a dummy block
+// and their state is discarded
+template <typename Word, size_t Lanes, size_t BlockSize> struct MultiBuffer {
+    using Compress = void (*)(Word *state, const uint8_t *const *blocks, const Word *K);
+
+    static void Run(Compress compress,
+                    const Word *K,
+                    const Word *H,
+                    size_t resultBytes,
+                    const uint8_t *const *msgs,
+                    const size_t *lens,
+                    size_t count,
+                    uint8_t *out)
+    {
+        struct Lane {
+            size_t job;
+            const uint8_t *data;
+            size_t fullBlocks;
+            size_t totalBlocks;
+            size_t block;
+        };
+
+        Word state[8 * Lanes];
+        Lane lanes[Lanes];
+        uint8_t padding[Lanes][BlockSize * 2];
+        const uint8_t *blocks[Lanes];
+        static const uint8_t idle[BlockSize] = {};
+
+        size_t next = 0;
+        size_t active = 0;
+        for(size_t j = 0; j < Lanes; j++)
         {
-            if(pos == message.size())
+            lanes[j].job = count;
+            if(next < count)
             {
-                ptr = padding.data();
-                dpos = 0;
+                Start(lanes[j], j, next++, state, H, padding[j], msgs, lens);
+                active++;
             }
-            // copy chunk bytes into schedule array
-            W[pos % BlockSize / BaseTypeSize] |= static_cast<BaseType>(ptr[dpos])
-                                                 << ((BaseTypeSize * 8 - 8) - ((pos % BaseTypeSize) * 8));
-            dpos++;
-            pos++;
+        }
 
-            if((pos % BlockSize) == 0)
+        while(active > 0)
+        {
+            for(size_t j = 0; j < Lanes; j++)
             {
-                for(size_t i = 16; i < RoundCount; i++)
+                const Lane &lane = lanes[j];
+                if(lane.job == count)
                 {
-                    BaseType wk = W[i - 16];
-                    BaseType wl = W[i - 7];
-                    BaseType wi = W[i - 15];
-                    BaseType wj = W[i - 2];
-                    BaseType sig0 = sigma0(wi);
-                    BaseType sig1 = sigma1(wj);
-                    W[i] = wk + sig0 + wl + sig1;
+                    blocks[j] = idle;
                 }
-
-                for(size_t i = 0; i < 8; i++)
+                else if(lane.block < lane.fullBlocks)
+                {
+                    blocks[j] = lane.data + lane.block * BlockSize;
+                }
+                else
                 {
-                    value[i] = Hlocal[i];
+                    blocks[j] = padding[j] + (lane.block - lane.fullBlocks) * BlockSize;
                 }
+            }
 
-                for(size_t i = 0; i < RoundCount; i++)
+            compress(state, blocks, K);
+
+            for(size_t j = 0; j < Lanes; j++)
+            {
+                Lane &lane = lanes[j];
+                if(lane.job == count || ++lane.block < lane.totalBlocks)
                 {
-                    BaseType s1 = sum1(value[4]);
-                    BaseType choice = (value[4] & value[5]) ^ ((~value[4]) & value[6]);
-                    BaseType s0 = sum0(value[0]);
-                    BaseType majority = (value[0] & value[1]) ^ (value[0] & value[2]) ^ (value[1] & value[2]);
-                    BaseType temp1 = value[7] + s1 + choice + K[i] + W[i];
-                    BaseType temp2 = s0 + majority;
-
-                    value[7] = value[6];
-                    value[6] = value[5];
-                    value[5] = value[4];
-                    value[4] = value[3] + temp1;
-                    value[3] = value[2];
-                    value[2] = value[1];
-                    value[1] = value[0];
-                    value[0] = temp1 + temp2;
+                    continue;
                 }
 
-                for(size_t i = 0; i < 8; i++)
+                uint8_t *digest = out + lane.job * resultBytes;
+                for(size_t i = 0; i < resultBytes; i++)
                 {
-                    Hlocal[i] += value[i];
+                    Word word = state[(i / sizeof(Word)) * Lanes + j];
+                    digest[i] = static_cast<uint8_t>(word >> ((sizeof(Word) - 1 - i % sizeof(Word)) * 8));
                 }
 
-                if(pos < total)
+                lane.job = count;
+                if(next < count)
                 {
-                    clear(W, RoundCount);
+                    Start(lane, j, next++, state, H, padding[j], msgs, lens);
+                }
+                else
+                {
+                    active--;
                 }
             }
         }
-
-        std::vector<uint8_t> retval(ResultBytes);
-        for(size_t i = 0; i < ResultBytes; i += BaseTypeSize)
-        {
-            Sha2::num2arr(Hlocal[i / BaseTypeSize], std::min(ResultBytes - i, BaseTypeSize), retval, i);
-        }
-
-        return retval;
     }
 
-    template<typename L, typename = void>
-    struct is_container : std::false_type
-    {
-    };
-
-    template<typename L>
-    struct is_container<L,
-                        std::void_t<typename L::value_type,
-                                    typename L::size_type,
-                                    decltype(std::declval<L>().size()),
-                                    decltype(std::declval<L>().begin()),
-                                    decltype(std::declval<L>().end())>> : std::true_type
+private:
+    template <typename Lane>
+    static void Start(Lane &lane,
+                      size_t j,
+                      size_t job,
+                      Word *state,
+                      const Word *H,
+                      uint8_t *padding,
+                      const uint8_t *const *msgs,
+                      const size_t *lens)
     {
-    };
+        const size_t sizeBlockLength = sizeof(Word) * 2;
+        size_t length = lens[job];
+        size_t tail = length % BlockSize;
 
-    template<typename L>
-    struct is_container_value
-    {
-        static const bool value = is_container<L>::value;
-    };
+        lane.job = job;
+        lane.data = msgs[job];
+        lane.fullBlocks = length / BlockSize;
+        lane.block = 0;
 
-    template<typename T1, typename T2>
-    std::vector<uint8_t> HMAC(const T1 &text, const T2 &key)
-    {
-        static_assert(is_container_value<T1>::value, "Must be a container");
-        static_assert(is_container_value<T2>::value, "Must be a container");
-        std::vector<uint8_t> key_padded(BlockSize, 0x0);
+        size_t padBlocks = (tail + 1 + sizeBlockLength > BlockSize) ? 2 : 1;
+        lane.totalBlocks = lane.fullBlocks + padBlocks;
 
-        size_t copy_size = std::min(key.size(), size_t(BlockSize));
-        for(size_t i = 0; i < copy_size; ++i)
+        std::fill(padding, padding + padBlocks * BlockSize, 0);
+        std::copy(msgs[job] + lane.fullBlocks * BlockSize, msgs[job] + length, padding);
+        padding[tail] = 0b10000000;
+        uint8_t *end = padding + padBlocks * BlockSize;
+        uint64_t bitLength = static_cast<uint64_t>(length) << 3;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
         {
-            key_padded[i] = key[i];
+            end[-1 - static_cast<ptrdiff_t>(i)] = static_cast<uint8_t>(bitLength >> (i * 8));
         }
-
-        std::vector<uint8_t> inner_key = key_padded;
-        for(size_t i = 0; i < inner_key.size(); ++i)
+        if(sizeBlockLength > sizeof(uint64_t))
         {
-            inner_key[i] ^= inner_pad_const;
+            end[-1 - static_cast<ptrdiff_t>(sizeof(uint64_t))] = static_cast<uint8_t>(static_cast<uint64_t>(length) >> 61);
         }
 
-        std::vector<uint8_t> outer_key = key_padded;
-        for(size_t i = 0; i < outer_key.size(); ++i)
+        for(size_t i = 0; i < 8; i++)
         {
-            outer_key[i] ^= outer_pad_const;
+            state[i * Lanes + j] = H[i];
         }
-
-        inner_key.insert(inner_key.end(), text.begin(), text.end());
-        std::vector<uint8_t> inner_key_hash = Hash(inner_key);
-        outer_key.insert(outer_key.end(), inner_key_hash.begin(), inner_key_hash.end());
-
-        return Hash(outer_key);
     }
+};
+#endif
 
-private:
-    using BaseType = typename Sha2Base<T>::BaseType;
-    using Sha2Base<T>::K;
-    using Sha2Base<T>::H;
-    using Sha2Base<T>::BlockSize;
+// Runs a batch on the widest lane kernel the CPU supports, returns false if there is none.
+// Sha256 is left to the single stream SHA-NI backend when present, it outruns 16 AVX-512 lanes
+inline bool HashManyLanes(const uint32_t *K,
+                          const uint32_t *H,
+                          size_t resultBytes,
+                          const uint8_t *const *msgs,
+                          const size_t *lens,
+                          size_t count,
+                          uint8_t *out)
+{
+#ifdef SHA2CPP_MULTI_BUFFER
+    const CpuFeatures &features = CpuFeatures::Get();
+    if(features.x86Sha)
+    {
+        return false;
+    }
+    if(features.avx512)
+    {
+        MultiBuffer<uint32_t, 16, 64>::Run(CompressLanesAvx512, K, H, resultBytes, msgs, lens, count, out);
+        return true;
+    }
+    if(features.avx2)
+    {
+        MultiBuffer<uint32_t, 8, 64>::Run(CompressLanesAvx2, K, H, resultBytes, msgs, lens, count, out);
+        return true;
+    }
+#else
+    (void)K, (void)H, (void)resultBytes, (void)msgs, (void)lens, (void)count, (void)out;
+#endif
+    return false;
+}
+
+inline bool HashManyLanes(const uint64_t *K,
+                          const uint64_t *H,
+                          size_t resultBytes,
+                          const uint8_t *const *msgs,
+                          const size_t *lens,
+                          size_t count,
+                          uint8_t *out)
+{
+#ifdef SHA2CPP_MULTI_BUFFER
+    const CpuFeatures &features = CpuFeatures::Get();
+    if(features.avx512)
+    {
+        MultiBuffer<uint64_t, 8, 128>::Run(CompressLanesAvx512, K, H, resultBytes, msgs, lens, count, out);
+        return true;
+    }
+    if(features.avx2)
+    {
+        MultiBuffer<uint64_t, 4, 128>::Run(CompressLanesAvx2, K, H, resultBytes, msgs, lens, count, out);
+        return true;
+    }
+#else
+    (void)K, (void)H, (void)resultBytes, (void)msgs, (void)lens, (void)count, (void)out;
+#endif
+    return false;
+}
+
+} // namespace detail
+
+template <HashType T> class HmacKey;
+
+template <HashType T> class Sha2 : public Sha2Base<T> {
+public:
+    using Sha2Base<T>::BlockSize;
+    static constexpr size_t DigestSize = Sha2Base<T>::ResultBytes;
+    using Digest = std::array<uint8_t, DigestSize>;
+
+    // Longest message in bytes. Sha224/256 store the bit length in 64 bits, so 2^61 - 1 bytes.
+    // The Sha512 family would allow 2^125 bytes but the length is counted in 64 bits here as
+    // well, that's still 16777216 TB. Update() throws std::length_error beyond it
+    static constexpr uint64_t MaxMessageSize
+        = sizeof(typename Sha2Base<T>::BaseType) == 4 ? (uint64_t(1) << 61) - 1 : UINT64_MAX;
+
+    Sha2() { Init(); }
+
+    // Hash() and HMAC() reset the streaming state, use a separate instance
+    // if a message is being hashed with Update() at the same time.
+    // The message is read in place, nothing is copied before hashing
+    std::vector<uint8_t> Hash(ByteView message)
+    {
+        Init();
+        Update(message.data(), message.size());
+        return Final();
+    }
+
+    std::vector<uint8_t> Hash(const void *data, size_t length) { return Hash(ByteView(data, length)); }
+
+    // allocation free variants, the digest is written to DigestSize bytes of caller storage
+    void Hash(ByteView message, uint8_t *digest)
+    {
+        Init();
+        Update(message.data(), message.size());
+        Final(digest);
+    }
+
+    void Hash(ByteView message, Digest &digest) { Hash(message, digest.data()); }
+
+    void Hash(const void *data, size_t length, uint8_t *digest) { Hash(ByteView(data, length), digest); }
+
+    // Hashes count independent messages, digest i is written to out + i * DigestSize.
+    // On CPUs with AVX2/AVX-512 the messages are interleaved across SIMD lanes
+    void HashMany(const uint8_t *const *msgs, const size_t *lens, size_t count, uint8_t *out)
+    {
+        if(count > 1 && detail::HashManyLanes(K, H, ResultBytes, msgs, lens, count, out))
+        {
+            return;
+        }
+
+        for(size_t i = 0; i < count; i++)
+        {
+            Hash(msgs[i], lens[i], out + i * ResultBytes);
+        }
+    }
+
+    // Digest of exactly N bytes, e.g. a 64 byte Merkle node made of two child digests.
+    // The length is a template argument, so the padding blocks are a compile time constant
+    // (detail::FixedPadding) and every branch below is on a constant. Only a block that
+    // holds the end of the message is assembled on the stack, a padding block without
+    // message bytes is compressed straight from the constant. The context of this instance
+    // is left untouched
+    template <size_t N> static void HashFixed(const uint8_t *message, uint8_t *digest)
+    {
+        using Padding = detail::FixedPadding<N, BlockSize, sizeof(BaseType) * 2>;
+
+        Compress compress = CompressKernel();
+        BaseType chain[8];
+        std::copy(H, H + 8, chain);
+        if(Padding::FullBlocks > 0)
+        {
+            compress(chain, message, Padding::FullBlocks);
+        }
+
+        if(Padding::Tail == 0)
+        {
+            compress(chain, Padding::Block, Padding::Blocks);
+        }
+        else
+        {
+            uint8_t last[BlockSize];
+            std::copy(message + Padding::FullBlocks * BlockSize, message + N, last);
+            std::copy(Padding::Block + Padding::Tail, Padding::Block + BlockSize, last + Padding::Tail);
+            compress(chain, last, 1);
+            if(Padding::Blocks == 2)
+            {
+                compress(chain, Padding::Block + BlockSize, 1);
+            }
+        }
+
+        for(size_t i = 0; i < ResultBytes; i += sizeof(BaseType))
+        {
+            Sha2::num2arr(chain[i / sizeof(BaseType)], std::min(ResultBytes - i, sizeof(BaseType)), digest, i);
+        }
+    }
+
+    template <size_t N> static Digest HashFixed(const uint8_t *message)
+    {
+        Digest digest;
+        HashFixed<N>(message, digest.data());
+        return digest;
+    }
+
+    template <size_t N> static Digest HashFixed(const std::array<uint8_t, N> &message)
+    {
+        return HashFixed<N>(message.data());
+    }
+
+    // Hash(Hash(message)) as used by Bitcoin (SHA-256d). The outer pass always covers
+    // DigestSize bytes and goes through HashFixed, for Sha256 it is a single block
+    static void DoubleHash(ByteView message, uint8_t *digest)
+    {
+        uint8_t inner[DigestSize];
+        Sha2 hasher;
+        hasher.Update(message.data(), message.size());
+        hasher.Final(inner);
+        HashFixed<DigestSize>(inner, digest);
+    }
+
+    static void DoubleHash(ByteView message, Digest &digest) { DoubleHash(message, digest.data()); }
+
+    static Digest DoubleHash(ByteView message)
+    {
+        Digest digest;
+        DoubleHash(message, digest.data());
+        return digest;
+    }
+
+    // fixed length variant, e.g. DoubleHash<64>() for the nodes of a Bitcoin Merkle tree
+    template <size_t N> static void DoubleHash(const uint8_t *message, uint8_t *digest)
+    {
+        uint8_t inner[DigestSize];
+        HashFixed<N>(message, inner);
+        HashFixed<DigestSize>(inner, digest);
+    }
+
+    // Streaming interface: Init(), any number of Update() calls, then Final().
+    // Only the chaining values and one partial block are kept between calls
+    void Init()
+    {
+        for(size_t i = 0; i < 8; i++)
+        {
+            state[i] = H[i];
+        }
+        messageLength = 0;
+    }
+
+    void Update(ByteView data) { Update(data.data(), data.size()); }
+
+    void Update(const void *message, size_t length)
+    {
+        if(length > MaxMessageSize - messageLength)
+        {
+            // the bit length would wrap around and give a wrong digest, the state is left as it was
+            throw std::length_error("Sha2Cpp::Sha2: message longer than MaxMessageSize");
+        }
+        const uint8_t *data = static_cast<const uint8_t *>(message);
+        size_t bufferLength = BufferLength();
+        messageLength += length;
+        Compress compress = CompressKernel();
+
+        if(bufferLength > 0)
+        {
+            size_t copy_size = std::min(length, BlockSize - bufferLength);
+            std::copy(data, data + copy_size, buffer + bufferLength);
+            bufferLength += copy_size;
+            data += copy_size;
+            length -= copy_size;
+
+            if(bufferLength < BlockSize)
+            {
+                return;
+            }
+            compress(state, buffer, 1);
+        }
+
+        if(length >= BlockSize)
+        {
+            size_t nblocks = length / BlockSize;
+            compress(state, data, nblocks);
+            data += nblocks * BlockSize;
+            length -= nblocks * BlockSize;
+        }
+
+        std::copy(data, data + length, buffer);
+    }
+
+    std::vector<uint8_t> Final()
+    {
+        std::vector<uint8_t> retval(ResultBytes);
+        Final(retval.data());
+        return retval;
+    }
+
+    void Final(Digest &digest) { Final(digest.data()); }
+
+    void Final(uint8_t *digest)
+    {
+        // the message length field is 64 bits for Sha224/256 and 128 bits for the others,
+        // the padding is built in place in the block buffer, spilling into a second block if needed
+        const size_t sizeBlockLength = sizeof(BaseType) * 2;
+        size_t bufferLength = BufferLength();
+        Compress compress = CompressKernel();
+
+        buffer[bufferLength++] = 0b10000000;
+        if(bufferLength > BlockSize - sizeBlockLength)
+        {
+            std::fill(buffer + bufferLength, buffer + BlockSize, 0);
+            compress(state, buffer, 1);
+            bufferLength = 0;
+        }
+        std::fill(buffer + bufferLength, buffer + BlockSize, 0);
+
+        // copy message length bits, the upper part is only non-zero for 128 bit fields
+        uint64_t bitLength = messageLength << 3;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            buffer[BlockSize - i - 1] = static_cast<uint8_t>((bitLength >> (i * 8)) & 0xFF);
+        }
+        if(sizeBlockLength > sizeof(uint64_t))
+        {
+            buffer[BlockSize - sizeof(uint64_t) - 1] = static_cast<uint8_t>(messageLength >> 61);
+        }
+        compress(state, buffer, 1);
+
+        for(size_t i = 0; i < ResultBytes; i += sizeof(BaseType))
+        {
+            Sha2::num2arr(state[i / sizeof(BaseType)], std::min(ResultBytes - i, sizeof(BaseType)), digest, i);
+        }
+
+        Init();
+    }
+
+    // Independent copy of the streaming state, e.g. to hash many suffixes after a shared prefix
+    Sha2 Clone() const { return *this; }
+
+    // Serialized streaming state: hash type, message length and chaining values in big endian
+    // followed by the buffered partial block, so the size depends on the data hashed so far
+    static constexpr size_t MaxExportSize
+        = 1 + sizeof(uint64_t) + 8 * sizeof(typename Sha2Base<T>::BaseType) + BlockSize;
+
+    // Writes the state to out (at most MaxExportSize bytes) and returns the number of bytes written.
+    // The bytes are platform independent, Import() resumes hashing in any process
+    size_t Export(uint8_t *out) const
+    {
+        size_t pos = 0;
+        out[pos++] = static_cast<uint8_t>(T);
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            out[pos++] = static_cast<uint8_t>(messageLength >> ((sizeof(uint64_t) - i - 1) * 8));
+        }
+        for(size_t i = 0; i < 8; i++, pos += sizeof(BaseType))
+        {
+            Sha2::num2arr(state[i], sizeof(BaseType), out, pos);
+        }
+        std::copy(buffer, buffer + BufferLength(), out + pos);
+        return pos + BufferLength();
+    }
+
+    std::vector<uint8_t> Export() const
+    {
+        std::vector<uint8_t> retval(MaxExportSize);
+        retval.resize(Export(retval.data()));
+        return retval;
+    }
+
+    // Restores a state written by Export() of the same hash type, returns false and leaves
+    // the context untouched if the data is malformed
+    bool Import(ByteView data)
+    {
+        const size_t header = 1 + sizeof(uint64_t) + 8 * sizeof(BaseType);
+        if(data.size() < header || data.data()[0] != static_cast<uint8_t>(T))
+        {
+            return false;
+        }
+
+        uint64_t length = 0;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            length = (length << 8) | data.data()[1 + i];
+        }
+        if(length > MaxMessageSize || data.size() != header + length % BlockSize)
+        {
+            return false;
+        }
+
+        for(size_t i = 0; i < 8; i++)
+        {
+            state[i] = Sha2Base<T>::load(data.data() + 1 + sizeof(uint64_t) + i * sizeof(BaseType));
+        }
+        messageLength = length;
+        std::copy(data.begin() + header, data.end(), buffer);
+        return true;
+    }
+
+#ifdef SHA2CPP_CONSTEXPR_HASH
+    // Digest evaluated by the compiler when used in a constant expression (C++17 and later),
+    // e.g. static constexpr auto schemaDigest = Sha2<HashType::Sha256>::ConstexprHash(schema);
+    // At run time it works as well but always uses the portable kernel
+    static constexpr Digest ConstexprHash(std::string_view message)
+    {
+        constexpr size_t sizeBlockLength = sizeof(BaseType) * 2;
+
+        BaseType chain[8] = {};
+        for(size_t i = 0; i < 8; i++)
+        {
+            chain[i] = H[i];
+        }
+
+        uint8_t block[BlockSize] = {};
+        size_t pos = 0;
+        for(; message.size() - pos >= BlockSize; pos += BlockSize)
+        {
+            for(size_t i = 0; i < BlockSize; i++)
+            {
+                block[i] = static_cast<uint8_t>(message[pos + i]);
+            }
+            CompressBlocksPortable(chain, block, 1);
+        }
+
+        size_t rest = message.size() - pos;
+        for(size_t i = 0; i < BlockSize; i++)
+        {
+            block[i] = i < rest ? static_cast<uint8_t>(message[pos + i]) : 0;
+        }
+        block[rest] = 0b10000000;
+        if(rest + 1 > BlockSize - sizeBlockLength)
+        {
+            CompressBlocksPortable(chain, block, 1);
+            for(size_t i = 0; i < BlockSize; i++)
+            {
+                block[i] = 0;
+            }
+        }
+
+        uint64_t bitLength = static_cast<uint64_t>(message.size()) << 3;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            block[BlockSize - i - 1] = static_cast<uint8_t>((bitLength >> (i * 8)) & 0xFF);
+        }
+        if(sizeBlockLength > sizeof(uint64_t))
+        {
+            block[BlockSize - sizeof(uint64_t) - 1] = static_cast<uint8_t>(static_cast<uint64_t>(message.size()) >> 61);
+        }
+        CompressBlocksPortable(chain, block, 1);
+
+        Digest digest = {};
+        for(size_t i = 0; i < ResultBytes; i++)
+        {
+            size_t shift = (sizeof(BaseType) - 1 - i % sizeof(BaseType)) * 8;
+            digest[i] = static_cast<uint8_t>(chain[i / sizeof(BaseType)] >> shift);
+        }
+        return digest;
+    }
+#endif
+
+    // one-off HMAC, use HmacKey to sign many messages with the same key
+    std::vector<uint8_t> HMAC(ByteView text, ByteView key) { return HmacKey<T>(key).Mac(text); }
+
+private:
+    using BaseType = typename Sha2Base<T>::BaseType;
+    using Sha2Base<T>::K;
+    using Sha2Base<T>::H;
     using Sha2Base<T>::RoundCount;
     using Sha2Base<T>::ResultBytes;
     using Sha2Base<T>::sigma0;
     using Sha2Base<T>::sigma1;
     using Sha2Base<T>::sum0;
     using Sha2Base<T>::sum1;
-    const size_t BaseTypeSize = sizeof(BaseType);
+    using Compress = typename Sha2Base<T>::Compress;
+    using Sha2Base<T>::CompressKernel;
+    using Sha2Base<T>::CompressBlocksPortable;
+
+    // The whole context, the constant tables are static. The partial block in buffer
+    // holds the last messageLength % BlockSize bytes
+    BaseType state[8];
+    uint8_t buffer[BlockSize];
+    uint64_t messageLength;
+
+    size_t BufferLength() const { return static_cast<size_t>(messageLength % BlockSize); }
+
+protected:
+    static void num2arr(BaseType n, size_t len, uint8_t *arr, size_t pos)
+    {
+        for(size_t i = 0; i < len; ++i)
+        {
+            arr[i + pos] = static_cast<uint8_t>(n >> ((sizeof(n) - i - 1) * 8) & 0xFF);
+        }
+    }
+};
+
+template <HashType T> constexpr size_t Sha2<T>::DigestSize;
+template <HashType T> constexpr size_t Sha2<T>::MaxExportSize;
+template <HashType T> constexpr uint64_t Sha2<T>::MaxMessageSize;
+
+template <HashType T> class Hmac;
+
+// HMAC key with the ipad and opad blocks already absorbed. Each Mac() starts from copies
+// of the two stored midstates, so signing a message costs only the message blocks and
+// the final outer block. As RFC 2104 requires, a key longer than BlockSize is replaced
+// by its digest, that happens once here so long keys cost nothing extra per message
+template <HashType T> class HmacKey {
+public:
+    static constexpr size_t BlockSize = Sha2<T>::BlockSize;
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+
+    explicit HmacKey(ByteView key)
+    {
+        uint8_t key_padded[BlockSize] = {};
+
+        if(key.size() > BlockSize)
+        {
+            inner.Hash(key, key_padded);
+        }
+        else
+        {
+            std::copy(key.data(), key.data() + key.size(), key_padded);
+        }
+
+        uint8_t pad[BlockSize];
+        for(size_t i = 0; i < BlockSize; ++i)
+        {
+            pad[i] = key_padded[i] ^ inner_pad_const;
+        }
+        inner.Update(pad, BlockSize);
+
+        for(size_t i = 0; i < BlockSize; ++i)
+        {
+            pad[i] = key_padded[i] ^ outer_pad_const;
+        }
+        outer.Update(pad, BlockSize);
+    }
+
+    std::vector<uint8_t> Mac(ByteView text) const
+    {
+        std::vector<uint8_t> retval(DigestSize);
+        Mac(text, retval.data());
+        return retval;
+    }
+
+    void Mac(ByteView text, typename Sha2<T>::Digest &mac) const { Mac(text, mac.data()); }
+
+    void Mac(ByteView text, uint8_t *mac) const
+    {
+        uint8_t inner_hash[DigestSize];
+        Sha2<T> hasher(inner);
+        hasher.Update(text);
+        hasher.Final(inner_hash);
+
+        Sha2<T> outer_hasher(outer);
+        outer_hasher.Update(inner_hash, DigestSize);
+        outer_hasher.Final(mac);
+    }
+
+private:
+    friend class Hmac<T>;
+
     static constexpr uint8_t inner_pad_const = 0x36;
     static constexpr uint8_t outer_pad_const = 0x5c;
 
-protected:
-    void clear(BaseType *arr, size_t size)
+    Sha2<T> inner;
+    Sha2<T> outer;
+};
+
+template <HashType T> constexpr size_t HmacKey<T>::BlockSize;
+template <HashType T> constexpr size_t HmacKey<T>::DigestSize;
+template <HashType T> constexpr uint8_t HmacKey<T>::inner_pad_const;
+template <HashType T> constexpr uint8_t HmacKey<T>::outer_pad_const;
+
+// Incremental HMAC for payloads that should not be held in memory: Update() any number
+// of times, then Final() or Verify(). Only one block of the message is buffered, after
+// Final()/Verify() the context starts over with the same key
+template <HashType T> class Hmac {
+public:
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+
+    explicit Hmac(ByteView key) : key(key), hasher(this->key.inner) {}
+    explicit Hmac(const HmacKey<T> &key) : key(key), hasher(key.inner) {}
+
+    // discards everything passed to Update() so far
+    void Init() { hasher = key.inner; }
+
+    void Update(ByteView data) { hasher.Update(data); }
+
+    void Update(const void *data, size_t length) { hasher.Update(data, length); }
+
+    std::vector<uint8_t> Final()
     {
-        for(size_t i = 0; i < size; i++)
+        std::vector<uint8_t> retval(DigestSize);
+        Final(retval.data());
+        return retval;
+    }
+
+    void Final(typename Sha2<T>::Digest &mac) { Final(mac.data()); }
+
+    void Final(uint8_t *mac)
+    {
+        uint8_t inner_hash[DigestSize];
+        hasher.Final(inner_hash);
+
+        hasher = key.outer;
+        hasher.Update(inner_hash, DigestSize);
+        hasher.Final(mac);
+
+        Init();
+    }
+
+    // Finishes the MAC and compares it with expected in constant time,
+    // expected must be a full DigestSize tag
+    bool Verify(ByteView expected)
+    {
+        uint8_t mac[DigestSize];
+        Final(mac);
+        return ConstantTimeEqual(ByteView(mac, DigestSize), expected);
+    }
+
+private:
+    HmacKey<T> key;
+    Sha2<T> hasher;
+};
+
+template <HashType T> constexpr size_t Hmac<T>::DigestSize;
+
+// Any Sha2 variant chosen at runtime behind one streaming interface. The context of the
+// selected Sha2<T> lives inside the Hasher (no allocation) and every call is forwarded
+// through one function pointer to its specialized code, so Update() dispatches once per
+// buffer and the blocks are hashed by the same kernels as with Sha2<T> directly.
+// Copies are independent contexts
+class Hasher {
+public:
+    // throws std::invalid_argument if type is not compiled in (see the WITH_* options)
+    explicit Hasher(HashType type) : ops(Find(type))
+    {
+        if(ops == nullptr)
         {
-            arr[i] = 0;
+            throw std::invalid_argument("Sha2Cpp::Hasher: hash type is not enabled");
         }
+        ops->construct(storage);
     }
 
-    static void num2arr(BaseType n, size_t len, std::vector<uint8_t> &arr, size_t pos)
+    static bool Supported(HashType type) { return Find(type) != nullptr; }
+
+    HashType Type() const { return ops->type; }
+    size_t DigestSize() const { return ops->digestSize; }
+    size_t BlockSize() const { return ops->blockSize; }
+    size_t MaxExportSize() const { return ops->maxExportSize; }
+
+    std::vector<uint8_t> Hash(ByteView message)
     {
-        for(size_t i = 0; i < len; ++i)
+        std::vector<uint8_t> retval(DigestSize());
+        Hash(message, retval.data());
+        return retval;
+    }
+
+    void Hash(ByteView message, uint8_t *digest) { ops->hash(storage, message, digest); }
+
+    void Init() { ops->init(storage); }
+
+    void Update(ByteView data) { ops->update(storage, data); }
+
+    void Update(const void *data, size_t length) { ops->update(storage, ByteView(data, length)); }
+
+    std::vector<uint8_t> Final()
+    {
+        std::vector<uint8_t> retval(DigestSize());
+        Final(retval.data());
+        return retval;
+    }
+
+    void Final(uint8_t *digest) { ops->final(storage, digest); }
+
+    size_t Export(uint8_t *out) const { return ops->exportState(storage, out); }
+
+    std::vector<uint8_t> Export() const
+    {
+        std::vector<uint8_t> retval(MaxExportSize());
+        retval.resize(Export(retval.data()));
+        return retval;
+    }
+
+    bool Import(ByteView data) { return ops->importState(storage, data); }
+
+private:
+    struct Ops {
+        HashType type;
+        size_t digestSize;
+        size_t blockSize;
+        size_t maxExportSize;
+        void (*construct)(void *context);
+        void (*hash)(void *context, ByteView message, uint8_t *digest);
+        void (*init)(void *context);
+        void (*update)(void *context, ByteView data);
+        void (*final)(void *context, uint8_t *digest);
+        size_t (*exportState)(const void *context, uint8_t *out);
+        bool (*importState)(void *context, ByteView data);
+    };
+
+    // large enough for the Sha512 family: 8 words, one block and the length
+    static constexpr size_t storage_size = 8 * sizeof(uint64_t) + 128 + sizeof(uint64_t);
+
+    const Ops *ops;
+    alignas(uint64_t) uint8_t storage[storage_size];
+
+    template <HashType T> static Sha2<T> &Context(void *context) { return *static_cast<Sha2<T> *>(context); }
+
+    template <HashType T> static const Ops *Make()
+    {
+        static_assert(sizeof(Sha2<T>) <= storage_size && std::is_trivially_copyable<Sha2<T>>::value,
+                      "Sha2 context does not fit into Hasher");
+
+        static const Ops table = {
+            T,
+            Sha2<T>::DigestSize,
+            Sha2<T>::BlockSize,
+            Sha2<T>::MaxExportSize,
+            [](void *context) { new(context) Sha2<T>(); },
+            [](void *context, ByteView message, uint8_t *digest) { Context<T>(context).Hash(message, digest); },
+            [](void *context) { Context<T>(context).Init(); },
+            [](void *context, ByteView data) { Context<T>(context).Update(data); },
+            [](void *context, uint8_t *digest) { Context<T>(context).Final(digest); },
+            [](const void *context, uint8_t *out) { return static_cast<const Sha2<T> *>(context)->Export(out); },
+            [](void *context, ByteView data) { return Context<T>(context).Import(data); },
+        };
+        return &table;
+    }
+
+    static const Ops *Find(HashType type)
+    {
+        switch(type)
         {
-            arr[i + pos] = static_cast<uint8_t>(n >> ((sizeof(n) - i - 1) * 8) & 0xFF);
+#ifdef WITH_SHA256
+        case HashType::Sha256:
+            return Make<HashType::Sha256>();
+#endif
+#ifdef WITH_SHA224
+        case HashType::Sha224:
+            return Make<HashType::Sha224>();
+#endif
+#ifdef WITH_SHA512
+        case HashType::Sha512:
+            return Make<HashType::Sha512>();
+#endif
+#ifdef WITH_SHA384
+        case HashType::Sha384:
+            return Make<HashType::Sha384>();
+#endif
+#ifdef WITH_SHA512_256
+        case HashType::Sha512_256:
+            return Make<HashType::Sha512_256>();
+#endif
+#ifdef WITH_SHA512_224
+        case HashType::Sha512_224:
+            return Make<HashType::Sha512_224>();
+#endif
+        default:
+            return nullptr;
         }
     }
 };
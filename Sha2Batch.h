@@ -0,0 +1,524 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_BATCH_H
+#define SHA2_BATCH_H
+
+#include "Sha2.h"
+#include "Sha2File.h"
+#include "Sha2ThreadPool.h"
+
+#include <exception>
+#include <future>
+#include <memory>
+
+namespace Sha2Cpp {
+
+namespace detail {
+
+// Bounded multi-producer multi-consumer queue after D. Vyukov: every cell carries a
+// sequence number telling producers and consumers whose turn it is, so pushing and
+// popping are a single compare-and-swap on the tail or head index
+template <typename V, size_t Capacity> class MpmcQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MpmcQueue() : head(0), tail(0)
+    {
+        for(size_t i = 0; i < Capacity; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    bool TryPush(V value)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell &cell = cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if(sequence == pos)
+            {
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(sequence < pos)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool TryPop(V &value)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell &cell = cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if(sequence == pos + 1)
+            {
+                if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(sequence < pos + 1)
+            {
+                return false;
+            }
+            else
+            {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        V value;
+    };
+
+    // head and tail are kept on separate cache lines, producers and consumers do not contend
+    Cell cells[Capacity];
+    char padding0[64];
+    std::atomic<size_t> head;
+    char padding1[64];
+    std::atomic<size_t> tail;
+};
+
+// Type erased entry points of one hash type for the batch hasher. Each worker thread
+// keeps its own context per hash type, nothing is shared between threads
+struct BatchKernel {
+    size_t digestSize;
+    size_t maxExportSize;
+    void (*hash)(ByteView message, uint8_t *digest);
+    bool (*hashFile)(const std::string &path, uint8_t *digest);
+    // continues the exported state with data, then either finishes into digest
+    // (if digest is not null) or exports the state again, returns the export size
+    size_t (*resume)(uint8_t *state, size_t stateSize, ByteView data, uint8_t *digest);
+
+    template <HashType T> static BatchKernel Make()
+    {
+        return {Sha2<T>::DigestSize, Sha2<T>::MaxExportSize, &Hash<T>, &File<T>, &Resume<T>};
+    }
+
+private:
+    template <HashType T> static Sha2<T> &Context()
+    {
+        static thread_local Sha2<T> context;
+        return context;
+    }
+
+    template <HashType T> static void Hash(ByteView message, uint8_t *digest) { Context<T>().Hash(message, digest); }
+
+    // files of a batch may change while they are hashed, they are read rather than mapped
+    template <HashType T> static bool File(const std::string &path, uint8_t *digest)
+    {
+        return HashFile<T>(path, digest, FileAccess::Read);
+    }
+
+    template <HashType T> static size_t Resume(uint8_t *state, size_t stateSize, ByteView data, uint8_t *digest)
+    {
+        Sha2<T> &context = Context<T>();
+        if(stateSize == 0)
+        {
+            context.Init();
+        }
+        else
+        {
+            context.Import(ByteView(state, stateSize));
+        }
+        context.Update(data);
+        if(digest != nullptr)
+        {
+            context.Final(digest);
+            return 0;
+        }
+        return context.Export(state);
+    }
+};
+
+inline bool MakeBatchKernel(HashType type, BatchKernel &kernel)
+{
+    switch(type)
+    {
+#ifdef WITH_SHA256
+    case HashType::Sha256:
+        kernel = BatchKernel::Make<HashType::Sha256>();
+        return true;
+#endif
+#ifdef WITH_SHA224
+    case HashType::Sha224:
+        kernel = BatchKernel::Make<HashType::Sha224>();
+        return true;
+#endif
+#ifdef WITH_SHA512
+    case HashType::Sha512:
+        kernel = BatchKernel::Make<HashType::Sha512>();
+        return true;
+#endif
+#ifdef WITH_SHA384
+    case HashType::Sha384:
+        kernel = BatchKernel::Make<HashType::Sha384>();
+        return true;
+#endif
+#ifdef WITH_SHA512_256
+    case HashType::Sha512_256:
+        kernel = BatchKernel::Make<HashType::Sha512_256>();
+        return true;
+#endif
+#ifdef WITH_SHA512_224
+    case HashType::Sha512_224:
+        kernel = BatchKernel::Make<HashType::Sha512_224>();
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+} // namespace detail
+
+// Hashes batches of buffers or files on a thread pool and reports the digests through a
+// future or a completion callback. Digest i of a batch belongs to input i, a file that
+// cannot be read gets an empty digest.
+//
+// Work is spread through one lock-free FIFO queue: a batch entry is popped, one input is
+// claimed from it and the entry goes back to the tail while that input is hashed, so any
+// number of workers share a batch and concurrent batches are served round robin.
+// Buffers larger than sliceSize are hashed one slice per turn, their state travels
+// through the queue in exported form, so a huge input never holds back small ones for
+// longer than a slice. Files are read in one turn each.
+// The BatchHasher must outlive the batches, the destructor waits for them. An exception
+// thrown by a completion callback is kept and rethrown by Wait(), the destructor drops it
+class BatchHasher {
+public:
+    using Digests = std::vector<std::vector<uint8_t>>;
+    using Callback = std::function<void(Digests digests)>;
+
+    static constexpr size_t DefaultSliceSize = 1 << 20;
+
+    explicit BatchHasher(ThreadPool &pool = ThreadPool::Default(), size_t sliceSize = DefaultSliceSize)
+        : pool(pool), sliceSize(std::max<size_t>(sliceSize / 128, 1) * 128), drainers(0), running(0), outstanding(0)
+    {
+    }
+
+    ~BatchHasher()
+    {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idle.wait(lock, [this]() { return outstanding == 0 && running == 0; });
+    }
+
+    // Returns once every batch submitted so far has completed. The first exception thrown by
+    // a completion callback since the last Wait() is rethrown here, the other batches are
+    // not affected by it
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idle.wait(lock, [this]() { return outstanding == 0; });
+        std::exception_ptr error = callbackError;
+        callbackError = nullptr;
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    BatchHasher(const BatchHasher &) = delete;
+    BatchHasher &operator=(const BatchHasher &) = delete;
+
+    // The buffers are not copied and must stay valid until the batch completes.
+    // done runs on a worker thread once all digests are ready, also for an empty batch, what
+    // it throws is rethrown by Wait().
+    // Throws std::invalid_argument if type is not compiled in (see the WITH_* options)
+    void Submit(HashType type, std::vector<ByteView> buffers, Callback done)
+    {
+        Batch *batch = NewBatch(type, buffers.size(), std::move(done));
+        batch->buffers = std::move(buffers);
+        Start(batch);
+    }
+
+    void SubmitFiles(HashType type, std::vector<std::string> paths, Callback done)
+    {
+        Batch *batch = NewBatch(type, paths.size(), std::move(done));
+        batch->paths = std::move(paths);
+        Start(batch);
+    }
+
+    std::future<Digests> Submit(HashType type, std::vector<ByteView> buffers)
+    {
+        std::shared_ptr<std::promise<Digests>> promise = std::make_shared<std::promise<Digests>>();
+        std::future<Digests> result = promise->get_future();
+        Submit(type, std::move(buffers), [promise](Digests digests) { promise->set_value(std::move(digests)); });
+        return result;
+    }
+
+    std::future<Digests> SubmitFiles(HashType type, std::vector<std::string> paths)
+    {
+        std::shared_ptr<std::promise<Digests>> promise = std::make_shared<std::promise<Digests>>();
+        std::future<Digests> result = promise->get_future();
+        SubmitFiles(type, std::move(paths), [promise](Digests digests) { promise->set_value(std::move(digests)); });
+        return result;
+    }
+
+private:
+    struct Batch;
+
+    // index == claim marks the batch entry itself, other entries continue one large buffer
+    struct Entry {
+        Batch *batch;
+        size_t index;
+        size_t offset;
+        size_t stateSize;
+        std::vector<uint8_t> state;
+    };
+
+    struct Batch {
+        detail::BatchKernel kernel;
+        std::vector<ByteView> buffers;
+        std::vector<std::string> paths;
+        Digests digests;
+        Callback done;
+        std::atomic<size_t> next;
+        std::atomic<size_t> remaining;
+        Entry claim;
+    };
+
+    static constexpr size_t claim = SIZE_MAX;
+    static constexpr size_t queue_capacity = 1 << 12;
+
+    ThreadPool &pool;
+    size_t sliceSize;
+    detail::MpmcQueue<Entry *, queue_capacity> queue;
+    // drainers limits the Drain() tasks to the pool size, running and outstanding (guarded
+    // by idleMutex) count live tasks and batches for the destructor, callbackError keeps
+    // the first exception of a completion callback for Wait()
+    std::atomic<size_t> drainers;
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    size_t running;
+    size_t outstanding;
+    std::exception_ptr callbackError;
+
+    Batch *NewBatch(HashType type, size_t count, Callback done)
+    {
+        detail::BatchKernel kernel;
+        if(!detail::MakeBatchKernel(type, kernel))
+        {
+            throw std::invalid_argument("Sha2Cpp::BatchHasher: hash type is not enabled");
+        }
+
+        Batch *batch = new Batch();
+        batch->kernel = kernel;
+        batch->digests.resize(count);
+        batch->done = std::move(done);
+        batch->next.store(0);
+        batch->remaining.store(count);
+        batch->claim = {batch, claim, 0, 0, {}};
+        return batch;
+    }
+
+    void Start(Batch *batch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            outstanding++;
+        }
+        if(batch->digests.empty())
+        {
+            // nothing to hash, the callback still runs on a worker
+            pool.Submit([this, batch]() { Finish(batch); });
+            return;
+        }
+        Push(&batch->claim);
+    }
+
+    void Push(Entry *entry)
+    {
+        while(!queue.TryPush(entry))
+        {
+            // the queue only holds batches and unfinished large buffers, it is full only
+            // under thousands of concurrent batches, help draining it
+            Entry *other;
+            if(queue.TryPop(other))
+            {
+                Process(other);
+            }
+        }
+
+        size_t count = drainers.load();
+        while(count < pool.Size())
+        {
+            if(drainers.compare_exchange_weak(count, count + 1))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(idleMutex);
+                    running++;
+                }
+                pool.Submit([this]() { Drain(); });
+                break;
+            }
+        }
+    }
+
+    void Drain()
+    {
+        for(;;)
+        {
+            Entry *entry;
+            while(queue.TryPop(entry))
+            {
+                Process(entry);
+            }
+
+            // an entry pushed after the failed pop may have seen all drainers busy
+            drainers.fetch_sub(1);
+            if(!queue.TryPop(entry))
+            {
+                break;
+            }
+            drainers.fetch_add(1);
+            Process(entry);
+        }
+
+        std::lock_guard<std::mutex> lock(idleMutex);
+        running--;
+        idle.notify_all();
+    }
+
+    void Process(Entry *entry)
+    {
+        Batch *batch = entry->batch;
+        if(entry->index != claim)
+        {
+            Continue(entry);
+            return;
+        }
+
+        size_t index = batch->next.fetch_add(1);
+        if(index >= batch->digests.size())
+        {
+            return;
+        }
+        if(index + 1 < batch->digests.size())
+        {
+            Push(entry);
+        }
+
+        std::vector<uint8_t> &digest = batch->digests[index];
+        digest.resize(batch->kernel.digestSize);
+        if(!batch->paths.empty())
+        {
+            if(!batch->kernel.hashFile(batch->paths[index], digest.data()))
+            {
+                digest.clear();
+            }
+            Complete(batch);
+        }
+        else if(batch->buffers[index].size() <= sliceSize)
+        {
+            batch->kernel.hash(batch->buffers[index], digest.data());
+            Complete(batch);
+        }
+        else
+        {
+            Continue(new Entry{batch, index, 0, 0, std::vector<uint8_t>(batch->kernel.maxExportSize)});
+        }
+    }
+
+    // hashes the next slice of a large buffer
+    void Continue(Entry *entry)
+    {
+        Batch *batch = entry->batch;
+        ByteView input = batch->buffers[entry->index];
+        size_t length = std::min(sliceSize, input.size() - entry->offset);
+        bool last = entry->offset + length == input.size();
+
+        entry->stateSize = batch->kernel.resume(entry->state.data(), entry->stateSize,
+                                                ByteView(input.data() + entry->offset, length),
+                                                last ? batch->digests[entry->index].data() : nullptr);
+        entry->offset += length;
+
+        if(!last)
+        {
+            Push(entry);
+            return;
+        }
+        delete entry;
+        Complete(batch);
+    }
+
+    void Complete(Batch *batch)
+    {
+        if(batch->remaining.fetch_sub(1) == 1)
+        {
+            Finish(batch);
+        }
+    }
+
+    // runs on a pool worker, so nothing may escape: the batch is released and counted out
+    // also when the callback throws
+    void Finish(Batch *batch)
+    {
+        std::unique_ptr<Batch> owned(batch);
+        std::exception_ptr error;
+        try
+        {
+            owned->done(std::move(owned->digests));
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+        owned.reset();
+
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if(error && !callbackError)
+        {
+            callbackError = error;
+        }
+        outstanding--;
+        idle.notify_all();
+    }
+};
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_BATCH_H
@@ -0,0 +1,521 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_CACHE_H
+#define SHA2_CACHE_H
+
+#include "Sha2.h"
+#include "Sha2File.h"
+
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef SHA2CPP_POSIX
+#include <sys/file.h>
+#endif
+
+namespace Sha2Cpp {
+
+#ifdef SHA2CPP_POSIX
+// Identity of a file's content as far as stat() can tell: device, inode, size and the
+// modification and status change times in nanoseconds
+struct FileIdentity {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    int64_t ctime;
+
+    static bool Get(const std::string &path, FileIdentity &identity)
+    {
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            return false;
+        }
+#if defined(__APPLE__)
+        const struct timespec &modified = info.st_mtimespec;
+        const struct timespec &changed = info.st_ctimespec;
+#else
+        const struct timespec &modified = info.st_mtim;
+        const struct timespec &changed = info.st_ctim;
+#endif
+        identity.device = static_cast<uint64_t>(info.st_dev);
+        identity.inode = static_cast<uint64_t>(info.st_ino);
+        identity.size = static_cast<uint64_t>(info.st_size);
+        identity.mtime = static_cast<int64_t>(modified.tv_sec) * 1000000000 + modified.tv_nsec;
+        identity.ctime = static_cast<int64_t>(changed.tv_sec) * 1000000000 + changed.tv_nsec;
+        return true;
+    }
+
+    bool operator==(const FileIdentity &other) const
+    {
+        return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime
+               && ctime == other.ctime;
+    }
+
+    bool operator!=(const FileIdentity &other) const { return !(*this == other); }
+};
+
+// Persistent cache of file digests, so that unchanged files cost a stat() instead of a read.
+// An entry is keyed by the path and the hash type and is valid while the FileIdentity of the
+// file is the one recorded with it.
+//
+// The cache file is a log of fixed size records that is read through a shared mapping and
+// indexed in memory. Any number of processes may use one cache file: a new digest is one
+// append of a whole record (O_APPEND), later records win, and records appended by others
+// are picked up when a lookup misses. Once the log holds more than twice as many records as
+// live entries it is compacted into a new file that is renamed over the old one, appenders
+// hold a shared flock() and compaction an exclusive one, so no record is lost on the way.
+// Record layout, integers in little endian, 128 bytes:
+//   path hash, device, inode, size, mtime, ctime (8 bytes each), hash type, digest size,
+//   6 zero bytes, digest (64 bytes, zero padded), checksum of the preceding bytes (8 bytes)
+// A DigestCache object may be shared by threads
+class DigestCache {
+public:
+    DigestCache() : fd(-1), base(nullptr), mappedSize(0), parsed(0), records(0) {}
+    ~DigestCache() { Close(); }
+
+    DigestCache(const DigestCache &) = delete;
+    DigestCache &operator=(const DigestCache &) = delete;
+
+    // Opens the cache at path or creates an empty one, returns false on I/O errors or if the
+    // file is not a digest cache
+    bool Open(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseFile();
+        entries.clear();
+        logPath = path;
+        return OpenFile();
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseFile();
+        entries.clear();
+    }
+
+    bool IsOpen() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fd >= 0;
+    }
+
+    // number of live entries
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    // Copies the digest of the file at path into digest if an entry of this type exists and
+    // the file still has the identity recorded with it
+    bool Lookup(const std::string &path, HashType type, const FileIdentity &identity, uint8_t *digest)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(fd < 0)
+        {
+            return false;
+        }
+        if(Find(path, type, identity, digest))
+        {
+            return true;
+        }
+        // the entry may have been added by another process since the last look
+        return Refresh() && Find(path, type, identity, digest);
+    }
+
+    bool Lookup(const std::string &path, HashType type, uint8_t *digest)
+    {
+        FileIdentity identity;
+        return FileIdentity::Get(path, identity) && Lookup(path, type, identity, digest);
+    }
+
+    // Records the digest of the file at path that had the given identity while it was hashed
+    bool Store(const std::string &path, HashType type, const FileIdentity &identity, const uint8_t *digest)
+    {
+        if(!Hasher::Supported(type))
+        {
+            return false;
+        }
+
+        uint8_t record[record_size] = {};
+        Save(record, PathHash(path));
+        Save(record + 8, identity.device);
+        Save(record + 16, identity.inode);
+        Save(record + 24, identity.size);
+        Save(record + 32, static_cast<uint64_t>(identity.mtime));
+        Save(record + 40, static_cast<uint64_t>(identity.ctime));
+        record[48] = static_cast<uint8_t>(type);
+        record[49] = static_cast<uint8_t>(Hasher(type).DigestSize());
+        std::copy(digest, digest + record[49], record + 56);
+        Save(record + checksum_offset, Checksum(record));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(fd < 0 || !Append(record))
+        {
+            return false;
+        }
+        Refresh();
+        if(records > 2 * entries.size() + compact_slack)
+        {
+            CompactFile();
+        }
+        return true;
+    }
+
+    // Rewrites the log with one record per live entry, Store() does it on its own once the
+    // log has grown to more than twice the live entries
+    bool Compact()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fd >= 0 && CompactFile();
+    }
+
+private:
+    struct Entry {
+        size_t offset;
+        FileIdentity identity;
+    };
+
+    static constexpr size_t header_size = 16;
+    static constexpr size_t record_size = 128;
+    static constexpr size_t checksum_offset = 120;
+    static constexpr uint32_t version = 1;
+    static constexpr size_t compact_slack = 4096;
+
+    mutable std::mutex mutex;
+    std::string logPath;
+    int fd;
+    const uint8_t *base;
+    size_t mappedSize;
+    // bytes of the log indexed so far and the number of valid records in them
+    size_t parsed;
+    size_t records;
+    // path hash and hash type -> latest record
+    std::unordered_map<uint64_t, Entry> entries;
+
+    static void Save(uint8_t *p, uint64_t value)
+    {
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            p[i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    static uint64_t Load(const uint8_t *p)
+    {
+        uint64_t value = 0;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            value |= static_cast<uint64_t>(p[i]) << (i * 8);
+        }
+        return value;
+    }
+
+    // FNV-1a, only spreads paths over the table, every hit is confirmed by the file identity
+    static uint64_t PathHash(const std::string &path)
+    {
+        uint64_t hash = 0xcbf29ce484222325;
+        for(char c : path)
+        {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    static uint64_t Checksum(const uint8_t *record)
+    {
+        uint64_t hash = 0xcbf29ce484222325;
+        for(size_t i = 0; i < checksum_offset; i++)
+        {
+            hash = (hash ^ record[i]) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    static uint64_t Key(uint64_t pathHash, uint8_t type) { return pathHash * 8 + type; }
+
+    bool Find(const std::string &path, HashType type, const FileIdentity &identity, uint8_t *digest) const
+    {
+        auto found = entries.find(Key(PathHash(path), static_cast<uint8_t>(type)));
+        if(found == entries.end() || found->second.identity != identity)
+        {
+            return false;
+        }
+        const uint8_t *record = base + found->second.offset;
+        if(record[48] != static_cast<uint8_t>(type))
+        {
+            return false;
+        }
+        std::copy(record + 56, record + 56 + record[49], digest);
+        return true;
+    }
+
+    bool OpenFile()
+    {
+        do
+        {
+            fd = open(logPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        } while(fd < 0 && errno == EINTR);
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        // the first opener writes the header, the lock keeps a concurrent append out of its way
+        struct stat info;
+        bool ok = flock(fd, LOCK_EX) == 0 && fstat(fd, &info) == 0;
+        if(ok && info.st_size == 0)
+        {
+            uint8_t header[header_size] = {'S', 'H', 'A', '2', 'D', 'C', 'A', 'C'};
+            header[8] = static_cast<uint8_t>(version);
+            header[12] = static_cast<uint8_t>(record_size);
+            ok = write(fd, header, header_size) == static_cast<ssize_t>(header_size);
+        }
+        flock(fd, LOCK_UN);
+
+        if(!ok || !Refresh())
+        {
+            CloseFile();
+            return false;
+        }
+        return true;
+    }
+
+    void CloseFile()
+    {
+        Unmap();
+        if(fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        parsed = 0;
+        records = 0;
+    }
+
+    void Unmap()
+    {
+        if(base != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(base), mappedSize);
+            base = nullptr;
+            mappedSize = 0;
+        }
+    }
+
+    // Follows the log: reopens it if it has been compacted by someone else, maps what
+    // was appended since the last call and indexes the new records
+    bool Refresh()
+    {
+        struct stat current, named;
+        if(fstat(fd, &current) != 0)
+        {
+            return false;
+        }
+        if(stat(logPath.c_str(), &named) == 0 && (named.st_ino != current.st_ino || named.st_dev != current.st_dev))
+        {
+            CloseFile();
+            entries.clear();
+            return OpenFile();
+        }
+
+        size_t size = static_cast<size_t>(current.st_size);
+        if(size < header_size)
+        {
+            return false;
+        }
+        if(size > mappedSize)
+        {
+            Unmap();
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if(mapping == MAP_FAILED)
+            {
+                return false;
+            }
+            base = static_cast<const uint8_t *>(mapping);
+            mappedSize = size;
+        }
+
+        if(parsed == 0)
+        {
+            if(!std::equal(base, base + 8, "SHA2DCAC") || base[8] != version || base[12] != record_size)
+            {
+                return false;
+            }
+            parsed = header_size;
+        }
+
+        // a torn record at the end is still being written, it is picked up next time
+        for(; parsed + record_size <= mappedSize; parsed += record_size)
+        {
+            const uint8_t *record = base + parsed;
+            if(Load(record + checksum_offset) != Checksum(record) || record[49] > 64)
+            {
+                continue;
+            }
+            Entry entry = {parsed,
+                           {Load(record + 8), Load(record + 16), Load(record + 24),
+                            static_cast<int64_t>(Load(record + 32)), static_cast<int64_t>(Load(record + 40))}};
+            entries[Key(Load(record), record[48])] = entry;
+            records++;
+        }
+        return true;
+    }
+
+    // appends one record, retries on the new file if the log is compacted meanwhile
+    bool Append(const uint8_t *record)
+    {
+        for(;;)
+        {
+            if(flock(fd, LOCK_SH) != 0)
+            {
+                return false;
+            }
+            struct stat current, named;
+            bool replaced = fstat(fd, &current) != 0 || stat(logPath.c_str(), &named) != 0
+                            || named.st_ino != current.st_ino || named.st_dev != current.st_dev;
+            if(!replaced)
+            {
+                bool ok = write(fd, record, record_size) == static_cast<ssize_t>(record_size);
+                flock(fd, LOCK_UN);
+                return ok;
+            }
+            flock(fd, LOCK_UN);
+            CloseFile();
+            entries.clear();
+            if(!OpenFile())
+            {
+                return false;
+            }
+        }
+    }
+
+    bool CompactFile()
+    {
+        if(flock(fd, LOCK_EX) != 0)
+        {
+            return false;
+        }
+        struct stat current, named;
+        if(fstat(fd, &current) != 0 || stat(logPath.c_str(), &named) != 0 || named.st_ino != current.st_ino
+           || named.st_dev != current.st_dev)
+        {
+            // compacted by another process already
+            flock(fd, LOCK_UN);
+            CloseFile();
+            entries.clear();
+            return OpenFile();
+        }
+
+        // records appended up to the lock belong in the new file too
+        std::string next = logPath + ".compact";
+        int file = -1;
+        bool ok = Refresh();
+        if(ok)
+        {
+            do
+            {
+                file = open(next.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            } while(file < 0 && errno == EINTR);
+            ok = file >= 0;
+        }
+
+        if(ok)
+        {
+            std::vector<uint8_t> log(base, base + header_size);
+            log.reserve(header_size + entries.size() * record_size);
+            for(auto const &entry : entries)
+            {
+                log.insert(log.end(), base + entry.second.offset, base + entry.second.offset + record_size);
+            }
+            ok = write(file, log.data(), log.size()) == static_cast<ssize_t>(log.size()) && fsync(file) == 0
+                 && rename(next.c_str(), logPath.c_str()) == 0;
+        }
+        if(file >= 0)
+        {
+            close(file);
+        }
+        if(!ok)
+        {
+            unlink(next.c_str());
+        }
+        flock(fd, LOCK_UN);
+
+        // continue on the compacted file
+        CloseFile();
+        entries.clear();
+        return OpenFile() && ok;
+    }
+};
+
+// Digest of a file's content through the cache: an unchanged file costs one stat(), otherwise
+// the file is hashed and the digest recorded. A file that changes while it is hashed, or was
+// modified so recently that another change could share its timestamp, is not recorded.
+// Returns false (and leaves digest untouched) on I/O errors
+template <HashType T> bool HashFile(DigestCache &cache, const std::string &path, uint8_t *digest)
+{
+    FileIdentity before;
+    if(FileIdentity::Get(path, before) && cache.Lookup(path, T, before, digest))
+    {
+        return true;
+    }
+
+    // timestamps are only as fine as the file system makes them, a file written again within
+    // this window after being hashed could keep its identity
+    const int64_t racy_window = 2000000000;
+    int64_t now = static_cast<int64_t>(std::time(nullptr)) * 1000000000;
+    // read, not mapped: a file truncated under a mapping would raise SIGBUS
+    if(!HashFile<T>(path, digest, FileAccess::Read))
+    {
+        return false;
+    }
+
+    FileIdentity after;
+    if(FileIdentity::Get(path, after) && after == before && before.mtime < now - racy_window)
+    {
+        cache.Store(path, T, before, digest);
+    }
+    return true;
+}
+
+template <HashType T> std::vector<uint8_t> HashFile(DigestCache &cache, const std::string &path)
+{
+    std::vector<uint8_t> retval(Sha2<T>::DigestSize);
+    if(!HashFile<T>(cache, path, retval.data()))
+    {
+        return {};
+    }
+
+    return retval;
+}
+#endif
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_CACHE_H
@@ -0,0 +1,661 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_DEDUP_H
+#define SHA2_DEDUP_H
+
+#include "Sha2.h"
+#include "Sha2Batch.h"
+#include "Sha2File.h"
+#include "Sha2ThreadPool.h"
+
+#include <deque>
+
+#ifdef SHA2CPP_POSIX
+#include <sys/file.h>
+#endif
+
+namespace Sha2Cpp {
+
+// Content defined chunking after FastCDC. A gear hash (h = (h << 1) + gear[byte]) runs over
+// the data and a chunk ends where its top bits are zero, so the boundaries depend only on the
+// bytes nearby and an insertion shifts at most the chunks around it. Normalized chunking is
+// used: a stricter mask below the average size and a looser one above keep the sizes close
+// to the average. Chunks are at least averageSize / 4 and at most averageSize * 8 bytes,
+// the bytes below the minimum are skipped without hashing
+class Chunker {
+public:
+    static constexpr size_t DefaultAverageSize = 8192;
+
+    // averageSize is rounded down to a power of two, at least 64
+    explicit Chunker(size_t averageSize = DefaultAverageSize)
+    {
+        size_t bits = 6;
+        while(bits < 30 && (size_t(1) << (bits + 1)) <= averageSize)
+        {
+            bits++;
+        }
+        average = size_t(1) << bits;
+        minSize = average / 4;
+        maxSize = average * 8;
+        maskSmall = ~uint64_t(0) << (64 - (bits + 2));
+        maskLarge = ~uint64_t(0) << (64 - (bits - 2));
+        Reset();
+    }
+
+    size_t AverageSize() const { return average; }
+    size_t MinSize() const { return minSize; }
+    size_t MaxSize() const { return maxSize; }
+
+    // starts a new chunk
+    void Reset()
+    {
+        hash = 0;
+        position = 0;
+    }
+
+    // Scans data for the end of the current chunk and returns the number of leading bytes that
+    // belong to it. boundary is set if the chunk ends after them, the next call starts a new chunk
+    size_t Next(const uint8_t *data, size_t length, bool &boundary)
+    {
+        const uint64_t *gear = Gear();
+        // data[i] is byte position + i of the chunk
+        size_t i = std::min(length, minSize - std::min(position, minSize));
+
+        size_t smallEnd = std::min(length, average - std::min(position, average));
+        for(; i < smallEnd; i++)
+        {
+            hash = (hash << 1) + gear[data[i]];
+            if((hash & maskSmall) == 0)
+            {
+                return Cut(i + 1, boundary);
+            }
+        }
+
+        size_t largeEnd = std::min(length, maxSize - position);
+        for(; i < largeEnd; i++)
+        {
+            hash = (hash << 1) + gear[data[i]];
+            if((hash & maskLarge) == 0)
+            {
+                return Cut(i + 1, boundary);
+            }
+        }
+
+        if(position + i == maxSize)
+        {
+            return Cut(i, boundary);
+        }
+        position += i;
+        boundary = false;
+        return i;
+    }
+
+private:
+    size_t average;
+    size_t minSize;
+    size_t maxSize;
+    uint64_t maskSmall;
+    uint64_t maskLarge;
+    uint64_t hash;
+    size_t position;
+
+    size_t Cut(size_t length, bool &boundary)
+    {
+        Reset();
+        boundary = true;
+        return length;
+    }
+
+    // 256 random words from splitmix64, the same in every process so that chunk boundaries are stable
+    static const uint64_t *Gear()
+    {
+        struct Table {
+            uint64_t words[256];
+
+            Table()
+            {
+                uint64_t seed = 0x5348413243444321;
+                for(size_t i = 0; i < 256; i++)
+                {
+                    uint64_t z = (seed += 0x9e3779b97f4a7c15);
+                    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+                    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+                    words[i] = z ^ (z >> 31);
+                }
+            }
+        };
+        static const Table table;
+        return table.words;
+    }
+};
+
+#ifdef SHA2CPP_POSIX
+// On-disk set of chunk digests of one hash type, each with a 64 bit value chosen by the
+// caller (e.g. where the chunk is stored). The file is an open addressing hash table that
+// is used through a shared mapping, so opening an index costs nothing and a lookup touches
+// one or two pages. The table is kept at most half full, when it has to grow a doubled
+// copy is written next to the file and renamed over it, the old file stays valid until then.
+// Layout, integers in little endian:
+//   header: "SHA2DDUP", version (4 bytes), hash type, digest size, 2 zero bytes,
+//           capacity (8 bytes), count (8 bytes)
+//   slots:  capacity times (used flag, digest, value)
+// An index belongs to exactly one DedupIndex object, and so to one process, while it is open:
+// growing replaces the file without coordinating with other writers, so Open() takes an
+// exclusive flock() and fails while another handle holds the file. Lookups may run
+// concurrently, Insert() must not run concurrently with anything else
+class DedupIndex {
+public:
+    DedupIndex() : fd(-1), base(nullptr), mappedSize(0), type(HashType::Sha256), digestSize(0) {}
+    ~DedupIndex() { Close(); }
+
+    DedupIndex(const DedupIndex &) = delete;
+    DedupIndex &operator=(const DedupIndex &) = delete;
+
+    // Opens the index at path or creates an empty one, returns false on I/O errors, if the
+    // file is not an index of digests of this type, if the type is not compiled in or if the
+    // index is open in another DedupIndex
+    bool Open(const std::string &path, HashType type)
+    {
+        Close();
+        if(!Hasher::Supported(type))
+        {
+            return false;
+        }
+        this->path = path;
+        this->type = type;
+        digestSize = Hasher(type).DigestSize();
+
+        int file;
+        do
+        {
+            file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        } while(file < 0 && errno == EINTR);
+        if(file < 0)
+        {
+            return false;
+        }
+
+        // a file that was replaced by a grow while this open waited for it is not the index
+        // any more, its owner still holds the lock on the new one
+        struct stat info, named;
+        if(!Lock(file) || fstat(file, &info) != 0 || stat(path.c_str(), &named) != 0 || named.st_ino != info.st_ino
+           || named.st_dev != info.st_dev || (info.st_size == 0 && !Format(file, initial_capacity)) || !Map(file))
+        {
+            close(file);
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if(base != nullptr)
+        {
+            munmap(base, mappedSize);
+            base = nullptr;
+            mappedSize = 0;
+        }
+        if(fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool IsOpen() const { return base != nullptr; }
+    HashType Type() const { return type; }
+    size_t DigestSize() const { return digestSize; }
+    uint64_t Size() const { return base != nullptr ? Load(base + count_offset) : 0; }
+
+    // writes the changes made so far to disk
+    bool Sync() { return base != nullptr && msync(base, mappedSize, MS_SYNC) == 0; }
+
+    bool Contains(const uint8_t *digest) const
+    {
+        uint64_t value;
+        return Find(digest, value);
+    }
+
+    // Looks up digest (DigestSize bytes) and returns its value if it is present
+    bool Find(const uint8_t *digest, uint64_t &value) const
+    {
+        if(base == nullptr)
+        {
+            return false;
+        }
+        const uint8_t *slot = Probe(base, Capacity(), digest);
+        if(slot == nullptr || slot[0] == 0)
+        {
+            return false;
+        }
+        value = Load(slot + 1 + digestSize);
+        return true;
+    }
+
+    // Adds digest with value, a digest that is present keeps its value. Returns false only if
+    // the index could not grow or has no free slot left, which happens only to a corrupted file
+    bool Insert(const uint8_t *digest, uint64_t value)
+    {
+        if(base == nullptr)
+        {
+            return false;
+        }
+        if(Contains(digest))
+        {
+            return true;
+        }
+        if((Size() + 1) * 2 > Capacity() && !Grow())
+        {
+            return false;
+        }
+        if(!Put(base, Capacity(), digest, value))
+        {
+            return false;
+        }
+        Store(base + count_offset, Size() + 1);
+        return true;
+    }
+
+private:
+    static constexpr size_t header_size = 32;
+    static constexpr size_t capacity_offset = 16;
+    static constexpr size_t count_offset = 24;
+    static constexpr uint32_t version = 1;
+    static constexpr uint64_t initial_capacity = 1024;
+
+    int fd;
+    uint8_t *base;
+    size_t mappedSize;
+    std::string path;
+    HashType type;
+    size_t digestSize;
+
+    size_t SlotSize() const { return 1 + digestSize + sizeof(uint64_t); }
+    uint64_t Capacity() const { return Load(base + capacity_offset); }
+
+    static uint64_t Load(const uint8_t *p)
+    {
+        uint64_t value = 0;
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            value |= static_cast<uint64_t>(p[i]) << (i * 8);
+        }
+        return value;
+    }
+
+    static void Store(uint8_t *p, uint64_t value)
+    {
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            p[i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    // digests are uniformly distributed, their first bytes pick the home slot,
+    // collisions are resolved by linear probing. Returns the slot of digest or the free slot
+    // it belongs in, null if every slot is taken by another digest. The table is kept half
+    // empty, so that only happens to a corrupted file, the probe never runs past capacity slots
+    const uint8_t *Probe(const uint8_t *table, uint64_t capacity, const uint8_t *digest) const
+    {
+        size_t slotSize = SlotSize();
+        uint64_t i = Load(digest) & (capacity - 1);
+        for(uint64_t probed = 0; probed < capacity; probed++, i = (i + 1) & (capacity - 1))
+        {
+            const uint8_t *slot = table + header_size + i * slotSize;
+            if(slot[0] == 0 || std::equal(digest, digest + digestSize, slot + 1))
+            {
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    bool Put(uint8_t *table, uint64_t capacity, const uint8_t *digest, uint64_t value) const
+    {
+        uint8_t *slot = const_cast<uint8_t *>(Probe(table, capacity, digest));
+        if(slot == nullptr)
+        {
+            return false;
+        }
+        slot[0] = 1;
+        std::copy(digest, digest + digestSize, slot + 1);
+        Store(slot + 1 + digestSize, value);
+        return true;
+    }
+
+    // the lock goes with the descriptor, it is released when the file is closed
+    static bool Lock(int file)
+    {
+        int result;
+        do
+        {
+            result = flock(file, LOCK_EX | LOCK_NB);
+        } while(result != 0 && errno == EINTR);
+        return result == 0;
+    }
+
+    // writes an empty table of capacity slots to the empty file
+    bool Format(int file, uint64_t capacity) const
+    {
+        uint8_t header[header_size] = {'S', 'H', 'A', '2', 'D', 'D', 'U', 'P'};
+        header[8] = static_cast<uint8_t>(version);
+        header[12] = static_cast<uint8_t>(type);
+        header[13] = static_cast<uint8_t>(digestSize);
+        Store(header + capacity_offset, capacity);
+        return ftruncate(file, static_cast<off_t>(header_size + capacity * SlotSize())) == 0
+               && pwrite(file, header, header_size, 0) == static_cast<ssize_t>(header_size);
+    }
+
+    // maps file and takes it over if it is an index of this hash type
+    bool Map(int file)
+    {
+        struct stat info;
+        if(fstat(file, &info) != 0 || static_cast<uint64_t>(info.st_size) < header_size)
+        {
+            return false;
+        }
+        void *mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        if(mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        // the capacity is checked against the file size by division, a corrupted header with
+        // a huge capacity must not wrap around to the right size
+        uint8_t *table = static_cast<uint8_t *>(mapping);
+        uint64_t capacity = Load(table + capacity_offset);
+        uint64_t slotBytes = static_cast<uint64_t>(info.st_size) - header_size;
+        bool valid = std::equal(table, table + 8, "SHA2DDUP") && table[8] == version && table[12] == static_cast<uint8_t>(type)
+                     && table[13] == digestSize && capacity > 0 && (capacity & (capacity - 1)) == 0
+                     && slotBytes % SlotSize() == 0 && slotBytes / SlotSize() == capacity
+                     && Load(table + count_offset) <= capacity;
+        if(!valid)
+        {
+            munmap(mapping, static_cast<size_t>(info.st_size));
+            return false;
+        }
+
+        Close();
+        fd = file;
+        base = table;
+        mappedSize = static_cast<size_t>(info.st_size);
+        return true;
+    }
+
+    bool Grow()
+    {
+        std::string next = path + ".grow";
+        int file;
+        do
+        {
+            file = open(next.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        } while(file < 0 && errno == EINTR);
+        if(file < 0)
+        {
+            return false;
+        }
+
+        // locked before it is renamed into place, so the index is never unowned
+        uint64_t capacity = Capacity() * 2;
+        void *mapping = MAP_FAILED;
+        if(Lock(file) && Format(file, capacity))
+        {
+            mapping = mmap(nullptr, header_size + capacity * SlotSize(), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        }
+        if(mapping == MAP_FAILED)
+        {
+            close(file);
+            unlink(next.c_str());
+            return false;
+        }
+
+        uint8_t *table = static_cast<uint8_t *>(mapping);
+        for(uint64_t i = 0; i < Capacity(); i++)
+        {
+            const uint8_t *slot = base + header_size + i * SlotSize();
+            if(slot[0] != 0)
+            {
+                Put(table, capacity, slot + 1, Load(slot + 1 + digestSize));
+            }
+        }
+        Store(table + count_offset, Size());
+        munmap(mapping, header_size + capacity * SlotSize());
+
+        if(fsync(file) != 0 || rename(next.c_str(), path.c_str()) != 0)
+        {
+            close(file);
+            unlink(next.c_str());
+            return false;
+        }
+        if(!Map(file))
+        {
+            close(file);
+            return false;
+        }
+        return true;
+    }
+};
+
+// Chunk reported by Deduplicator, data and digest are valid during the callback only
+struct DedupChunk {
+    uint64_t offset;
+    ByteView data;
+    const uint8_t *digest;
+    // the digest was in the index already, value is the one stored with it
+    bool known;
+    uint64_t value;
+};
+
+// Splits streams into content defined chunks, fingerprints every chunk and records new
+// digests in a DedupIndex. The calling thread reads and chunks the input while the chunks
+// are hashed on the thread pool, at most a few chunks per worker are in flight. The chunks
+// are reported in stream order on the calling thread: record(chunk) is called for every
+// chunk and returns the value to store with a new digest, it is ignored for known chunks.
+// Must not be called from a task running on the same pool
+class Deduplicator {
+public:
+    using Callback = std::function<uint64_t(const DedupChunk &chunk)>;
+
+    struct Stats {
+        uint64_t chunks = 0;
+        uint64_t newChunks = 0;
+        uint64_t bytes = 0;
+        uint64_t newBytes = 0;
+    };
+
+    explicit Deduplicator(DedupIndex &index,
+                          size_t averageChunkSize = Chunker::DefaultAverageSize,
+                          ThreadPool &pool = ThreadPool::Default())
+        : index(index), chunker(averageChunkSize), pool(pool)
+    {
+    }
+
+    const Chunker &ChunkParameters() const { return chunker; }
+
+    // Deduplicates data as one stream and adds the totals to stats, returns false if the index
+    // is not open or could not be written
+    bool Add(ByteView data, const Callback &record, Stats &stats)
+    {
+        Stream stream(*this, record, stats);
+        stream.Feed(data.data(), data.size());
+        return stream.Finish();
+    }
+
+    // Same for the content of a file, returns false if it cannot be read. Chunks read before
+    // an I/O error have been reported and recorded
+    bool AddFile(const std::string &path, const Callback &record, Stats &stats)
+    {
+        Stream stream(*this, record, stats);
+        bool read = ReadFile(
+            path, [&stream](const uint8_t *data, size_t length) { stream.Feed(data, length); }, FileAccess::Read);
+        return stream.Finish() && read;
+    }
+
+private:
+    struct Job {
+        std::vector<uint8_t> data;
+        uint64_t offset;
+        uint8_t digest[64];
+        bool done;
+    };
+
+    // state of one Add() call, jobs holds the chunks in stream order
+    class Stream {
+    public:
+        Stream(Deduplicator &owner, const Callback &record, Stats &stats)
+            : owner(owner), record(record), stats(stats), chunker(owner.chunker), offset(0),
+              ok(owner.index.IsOpen() && detail::MakeBatchKernel(owner.index.Type(), kernel)),
+              current(new Job()), limit(std::max<size_t>(owner.pool.Size() * 4, 16))
+        {
+        }
+
+        ~Stream()
+        {
+            // the workers still reference the jobs if a callback has thrown
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this]() {
+                return std::all_of(jobs.begin(), jobs.end(), [](const std::unique_ptr<Job> &job) { return job->done; });
+            });
+        }
+
+        void Feed(const uint8_t *data, size_t length)
+        {
+            while(ok && length > 0)
+            {
+                bool boundary;
+                size_t count = chunker.Next(data, length, boundary);
+                current->data.insert(current->data.end(), data, data + count);
+                data += count;
+                length -= count;
+                if(boundary)
+                {
+                    Submit();
+                }
+            }
+        }
+
+        bool Finish()
+        {
+            if(ok && !current->data.empty())
+            {
+                Submit();
+            }
+            while(!jobs.empty())
+            {
+                Deliver();
+            }
+            return ok;
+        }
+
+    private:
+        Deduplicator &owner;
+        const Callback &record;
+        Stats &stats;
+        Chunker chunker;
+        uint64_t offset;
+        detail::BatchKernel kernel;
+        bool ok;
+        std::unique_ptr<Job> current;
+        std::deque<std::unique_ptr<Job>> jobs;
+        std::vector<std::unique_ptr<Job>> spare;
+        size_t limit;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void Submit()
+        {
+            Job *job = current.get();
+            job->offset = offset;
+            job->done = false;
+            offset += job->data.size();
+            jobs.push_back(std::move(current));
+
+            if(spare.empty())
+            {
+                current.reset(new Job());
+            }
+            else
+            {
+                current = std::move(spare.back());
+                spare.pop_back();
+                current->data.clear();
+            }
+
+            owner.pool.Submit([this, job]() {
+                kernel.hash(ByteView(job->data), job->digest);
+                std::lock_guard<std::mutex> lock(mutex);
+                job->done = true;
+                done.notify_all();
+            });
+
+            // report what is ready, wait only when too many chunks are in flight
+            while(!jobs.empty() && (jobs.size() >= limit || Ready()))
+            {
+                Deliver();
+            }
+        }
+
+        bool Ready()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return jobs.front()->done;
+        }
+
+        // waits for the oldest chunk, looks it up and records it
+        void Deliver()
+        {
+            Job *job = jobs.front().get();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [job]() { return job->done; });
+            }
+
+            DedupChunk chunk = {job->offset, ByteView(job->data), job->digest, false, 0};
+            chunk.known = owner.index.Find(job->digest, chunk.value);
+            uint64_t value = record ? record(chunk) : 0;
+            if(!chunk.known)
+            {
+                ok = ok && owner.index.Insert(job->digest, value);
+                stats.newChunks++;
+                stats.newBytes += job->data.size();
+            }
+            stats.chunks++;
+            stats.bytes += job->data.size();
+
+            spare.push_back(std::move(jobs.front()));
+            jobs.pop_front();
+        }
+    };
+
+    DedupIndex &index;
+    Chunker chunker;
+    ThreadPool &pool;
+};
+#endif
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_DEDUP_H
@@ -0,0 +1,280 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+
+#ifndef SHA2_ENCODING_H
+#define SHA2_ENCODING_H
+
+#include "Sha2.h"
+
+#if !defined(SHA2CPP_NO_INTRINSICS) \
+    && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SHA2CPP_SSE2
+#endif
+
+namespace Sha2Cpp {
+
+// Text encodings for digests, MACs and keys. The encoders and decoders write into caller
+// buffers, the std::string overloads are thin wrappers
+
+enum class Base64Alphabet {
+    Standard, // RFC 4648 section 4, '+' and '/', padded with '='
+    Url       // RFC 4648 section 5, '-' and '_', no padding
+};
+
+inline size_t HexEncodedSize(size_t length) { return length * 2; }
+
+// Writes 2 * data.size() lower case hex digits to out, no terminating zero
+inline size_t HexEncode(ByteView data, char *out)
+{
+    const uint8_t *in = data.data();
+    size_t length = data.size();
+    size_t i = 0;
+
+#ifdef SHA2CPP_SSE2
+    // 16 bytes at a time: split into nibbles, interleave them in output order and map
+    // 0-9 to '0'-'9' and 10-15 to 'a'-'f' with one compare, no table lookups
+    const __m128i lowMask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+    for(; i + 16 <= length; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask);
+        __m128i low = _mm_and_si128(bytes, lowMask);
+        __m128i first = _mm_unpacklo_epi8(high, low);
+        __m128i second = _mm_unpackhi_epi8(high, low);
+        first = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), letters));
+        second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), letters));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), first);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), second);
+    }
+#endif
+
+    static const char digits[] = "0123456789abcdef";
+    for(; i < length; i++)
+    {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+    return 2 * length;
+}
+
+inline std::string ToHex(ByteView data)
+{
+    std::string retval(HexEncodedSize(data.size()), '\0');
+    HexEncode(data, &retval[0]);
+    return retval;
+}
+
+// Decodes upper or lower case hex into hex.size() / 2 bytes, returns false on an odd
+// length or a character that is not a hex digit, out may be partially written then
+inline bool HexDecode(ByteView hex, uint8_t *out)
+{
+    if(hex.size() % 2 != 0)
+    {
+        return false;
+    }
+
+    // 0x10 marks invalid characters, or-ing both nibbles catches either one
+    auto value = [](uint8_t c) -> uint8_t {
+        return c >= '0' && c <= '9'   ? static_cast<uint8_t>(c - '0')
+               : c >= 'a' && c <= 'f' ? static_cast<uint8_t>(c - 'a' + 10)
+               : c >= 'A' && c <= 'F' ? static_cast<uint8_t>(c - 'A' + 10)
+                                      : static_cast<uint8_t>(0x10);
+    };
+
+    const uint8_t *in = hex.data();
+    uint8_t invalid = 0;
+    for(size_t i = 0; i < hex.size() / 2; i++)
+    {
+        uint8_t high = value(in[2 * i]);
+        uint8_t low = value(in[2 * i + 1]);
+        invalid |= high | low;
+        out[i] = static_cast<uint8_t>((high << 4) | (low & 0x0f));
+    }
+    return (invalid & 0x10) == 0;
+}
+
+// Decoded bytes, empty if hex is malformed
+inline std::vector<uint8_t> FromHex(ByteView hex)
+{
+    std::vector<uint8_t> retval(hex.size() / 2);
+    if(!HexDecode(hex, retval.data()))
+    {
+        return {};
+    }
+    return retval;
+}
+
+inline size_t Base64EncodedSize(size_t length, Base64Alphabet alphabet = Base64Alphabet::Standard)
+{
+    return alphabet == Base64Alphabet::Standard ? (length + 2) / 3 * 4 : (length * 4 + 2) / 3;
+}
+
+// Writes Base64EncodedSize(data.size(), alphabet) characters to out, no terminating zero
+inline size_t Base64Encode(ByteView data, char *out, Base64Alphabet alphabet = Base64Alphabet::Standard)
+{
+    static const char standard[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const char url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    const char *table = alphabet == Base64Alphabet::Standard ? standard : url;
+
+    const uint8_t *in = data.data();
+    size_t length = data.size();
+    char *start = out;
+    size_t i = 0;
+    for(; i + 3 <= length; i += 3, out += 4)
+    {
+        uint32_t group = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+        out[0] = table[group >> 18];
+        out[1] = table[(group >> 12) & 0x3f];
+        out[2] = table[(group >> 6) & 0x3f];
+        out[3] = table[group & 0x3f];
+    }
+
+    if(i < length)
+    {
+        uint32_t group = static_cast<uint32_t>(in[i]) << 16;
+        if(i + 1 < length)
+        {
+            group |= static_cast<uint32_t>(in[i + 1]) << 8;
+        }
+        *out++ = table[group >> 18];
+        *out++ = table[(group >> 12) & 0x3f];
+        if(i + 1 < length)
+        {
+            *out++ = table[(group >> 6) & 0x3f];
+        }
+        else if(alphabet == Base64Alphabet::Standard)
+        {
+            *out++ = '=';
+        }
+        if(alphabet == Base64Alphabet::Standard)
+        {
+            *out++ = '=';
+        }
+    }
+    return static_cast<size_t>(out - start);
+}
+
+inline std::string ToBase64(ByteView data, Base64Alphabet alphabet = Base64Alphabet::Standard)
+{
+    std::string retval(Base64EncodedSize(data.size(), alphabet), '\0');
+    Base64Encode(data, &retval[0], alphabet);
+    return retval;
+}
+
+// Upper bound of the decoded size, out of Base64Decode needs this much room
+inline size_t Base64DecodedMaxSize(size_t length) { return (length + 3) / 4 * 3; }
+
+// Decodes text into out and stores the number of bytes in length. Padding is required
+// for the standard alphabet and rejected for the url alphabet, returns false on any
+// malformed input (out may be partially written then)
+inline bool Base64Decode(ByteView text,
+                         uint8_t *out,
+                         size_t &length,
+                         Base64Alphabet alphabet = Base64Alphabet::Standard)
+{
+    const uint8_t *in = text.data();
+    size_t size = text.size();
+    if(alphabet == Base64Alphabet::Standard)
+    {
+        if(size % 4 != 0)
+        {
+            return false;
+        }
+        size_t padding = size > 0 && in[size - 1] == '=' ? (in[size - 2] == '=' ? 2 : 1) : 0;
+        size -= padding;
+    }
+    if(size % 4 == 1)
+    {
+        return false;
+    }
+
+    char plus = alphabet == Base64Alphabet::Standard ? '+' : '-';
+    char slash = alphabet == Base64Alphabet::Standard ? '/' : '_';
+    // 0x40 marks invalid characters
+    auto value = [plus, slash](uint8_t c) -> uint32_t {
+        return c >= 'A' && c <= 'Z'   ? c - 'A'
+               : c >= 'a' && c <= 'z' ? c - 'a' + 26
+               : c >= '0' && c <= '9' ? c - '0' + 52
+               : c == plus            ? 62
+               : c == slash           ? 63
+                                      : 0x40;
+    };
+
+    uint32_t invalid = 0;
+    uint8_t *start = out;
+    size_t i = 0;
+    for(; i + 4 <= size; i += 4)
+    {
+        uint32_t a = value(in[i]), b = value(in[i + 1]), c = value(in[i + 2]), d = value(in[i + 3]);
+        invalid |= a | b | c | d;
+        uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+        *out++ = static_cast<uint8_t>(group >> 16);
+        *out++ = static_cast<uint8_t>(group >> 8);
+        *out++ = static_cast<uint8_t>(group);
+    }
+
+    // 2 or 3 characters left, the bits beyond the last byte must be zero
+    if(i < size)
+    {
+        uint32_t a = value(in[i]), b = value(in[i + 1]);
+        uint32_t c = i + 2 < size ? value(in[i + 2]) : 0;
+        invalid |= a | b | c;
+        uint32_t group = (a << 18) | (b << 12) | (c << 6);
+        *out++ = static_cast<uint8_t>(group >> 16);
+        if(i + 2 < size)
+        {
+            *out++ = static_cast<uint8_t>(group >> 8);
+            invalid |= (group & 0xff) != 0 ? 0x40 : 0;
+        }
+        else
+        {
+            invalid |= (group & 0xffff) != 0 ? 0x40 : 0;
+        }
+    }
+
+    length = static_cast<size_t>(out - start);
+    return (invalid & 0x40) == 0;
+}
+
+// Decoded bytes, empty if text is malformed
+inline std::vector<uint8_t> FromBase64(ByteView text, Base64Alphabet alphabet = Base64Alphabet::Standard)
+{
+    std::vector<uint8_t> retval(Base64DecodedMaxSize(text.size()));
+    size_t length = 0;
+    if(!Base64Decode(text, retval.data(), length, alphabet))
+    {
+        return {};
+    }
+    retval.resize(length);
+    return retval;
+}
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_ENCODING_H
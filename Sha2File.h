@@ -0,0 +1,252 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_FILE_H
+#define SHA2_FILE_H
+
+#include "Sha2.h"
+
+#include <cstdio>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SHA2CPP_POSIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Sha2Cpp {
+
+#ifdef SHA2CPP_POSIX
+// Owns a file descriptor and closes it when it goes out of scope
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int descriptor) : fd(descriptor) {}
+    ~FileDescriptor()
+    {
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    int get() const { return fd; }
+
+private:
+    int fd;
+};
+
+// Read only mapping of a whole regular file
+class MappedFile {
+public:
+    MappedFile() : ptr(nullptr), length(0) {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Maps the file behind fd, returns false for empty, non regular or unmappable files
+    bool Open(int fd)
+    {
+        Close();
+
+        struct stat info;
+        if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0
+           || static_cast<uint64_t>(info.st_size) > static_cast<uint64_t>(SIZE_MAX / 2))
+        {
+            return false;
+        }
+
+        void *mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if(mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        ptr = static_cast<const uint8_t *>(mapping);
+        length = static_cast<size_t>(info.st_size);
+        return true;
+    }
+
+    void Close()
+    {
+        if(ptr != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(ptr), length);
+            ptr = nullptr;
+            length = 0;
+        }
+    }
+
+    // madvise() over [offset, offset + size), clamped to the mapping and widened to whole pages
+    void Advise(size_t offset, size_t size, int advice) const
+    {
+        if(offset >= length)
+        {
+            return;
+        }
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin = offset / page * page;
+        size_t end = std::min(length, offset + size);
+        madvise(const_cast<uint8_t *>(ptr) + begin, end - begin, advice);
+    }
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t *ptr;
+    size_t length;
+};
+#endif
+
+// How ReadFile gets at the content of a regular file
+enum class FileAccess {
+    // pread() into a buffer, safe when the file changes or shrinks while it is read
+    Read,
+    // memory mapped. Faster for large files, but if the file is truncated while it is read
+    // the process is killed by SIGBUS. Only for files nobody else writes meanwhile
+    Map,
+};
+
+// Streams the content of a file to consume(const uint8_t *data, size_t length) and
+// returns false if the file cannot be opened or read.
+// With FileAccess::Map regular files are mapped and handed over in windows straight from the
+// page cache: the next window is requested with MADV_WILLNEED while the current one is
+// consumed and consumed windows are dropped from the mapping. Otherwise, and for pipes,
+// devices and files that cannot be mapped, the file is read into a buffer with pread(), or
+// read() when the file is not seekable
+template <typename F> bool ReadFile(const std::string &path, F consume, FileAccess access = FileAccess::Read)
+{
+    static const size_t window = 16 << 20;
+    static const size_t buffer_size = 1 << 20;
+
+#ifdef SHA2CPP_POSIX
+    int descriptor;
+    do
+    {
+        descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    } while(descriptor < 0 && errno == EINTR);
+    if(descriptor < 0)
+    {
+        return false;
+    }
+    // closed on every way out, also when consume() throws
+    FileDescriptor file(descriptor);
+    int fd = file.get();
+
+    MappedFile mapping;
+    if(access == FileAccess::Map && mapping.Open(fd))
+    {
+        mapping.Advise(0, mapping.size(), MADV_SEQUENTIAL);
+        mapping.Advise(0, window, MADV_WILLNEED);
+        for(size_t pos = 0; pos < mapping.size(); pos += window)
+        {
+            mapping.Advise(pos + window, window, MADV_WILLNEED);
+            consume(mapping.data() + pos, std::min(window, mapping.size() - pos));
+            mapping.Advise(pos, window, MADV_DONTNEED);
+        }
+        return true;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::vector<uint8_t> buffer(buffer_size);
+    bool seekable = true;
+    off_t offset = 0;
+    for(;;)
+    {
+        ssize_t count = seekable ? pread(fd, buffer.data(), buffer.size(), offset)
+                                 : read(fd, buffer.data(), buffer.size());
+        if(count < 0 && errno == ESPIPE && seekable)
+        {
+            seekable = false;
+            continue;
+        }
+        if(count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(count <= 0)
+        {
+            return count == 0;
+        }
+        offset += count;
+        consume(buffer.data(), static_cast<size_t>(count));
+    }
+#else
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if(!file)
+    {
+        return false;
+    }
+
+    (void)access;
+    std::vector<uint8_t> buffer(buffer_size);
+    size_t count;
+    while((count = std::fread(buffer.data(), 1, buffer.size(), file.get())) > 0)
+    {
+        consume(buffer.data(), count);
+    }
+
+    return std::ferror(file.get()) == 0;
+#endif
+}
+
+// Digest of a file's content, returns false (and leaves digest untouched) on I/O errors.
+// See FileAccess before mapping files that may change
+template <HashType T> bool HashFile(const std::string &path, uint8_t *digest, FileAccess access = FileAccess::Read)
+{
+    Sha2<T> hasher;
+    if(!ReadFile(path, [&hasher](const uint8_t *data, size_t length) { hasher.Update(data, length); }, access))
+    {
+        return false;
+    }
+
+    hasher.Final(digest);
+    return true;
+}
+
+// Digest of a file's content, empty if the file cannot be read
+template <HashType T> std::vector<uint8_t> HashFile(const std::string &path, FileAccess access = FileAccess::Read)
+{
+    std::vector<uint8_t> retval(Sha2<T>::DigestSize);
+    if(!HashFile<T>(path, retval.data(), access))
+    {
+        return {};
+    }
+
+    return retval;
+}
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_FILE_H
@@ -0,0 +1,200 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_KDF_H
+#define SHA2_KDF_H
+
+#include "Sha2.h"
+#include "Sha2ThreadPool.h"
+
+namespace Sha2Cpp {
+
+namespace detail {
+// T_index = U_1 ^ U_2 ^ ... ^ U_iterations of RFC 8018, section 5.2
+template <HashType T>
+void Pbkdf2Block(const HmacKey<T> &key, ByteView salt, uint32_t iterations, uint32_t index, uint8_t *block)
+{
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+
+    const uint8_t counter[4] = {static_cast<uint8_t>(index >> 24), static_cast<uint8_t>(index >> 16),
+                                static_cast<uint8_t>(index >> 8), static_cast<uint8_t>(index)};
+    uint8_t u[DigestSize];
+
+    Hmac<T> prf(key);
+    prf.Update(salt);
+    prf.Update(counter, sizeof(counter));
+    prf.Final(u);
+    std::copy(u, u + DigestSize, block);
+
+    // the key padding is never touched again, every round only hashes the previous U
+    for(uint32_t i = 1; i < iterations; i++)
+    {
+        prf.Update(u, DigestSize);
+        prf.Final(u);
+        for(size_t j = 0; j < DigestSize; j++)
+        {
+            block[j] ^= u[j];
+        }
+    }
+}
+} // namespace detail
+
+// PBKDF2 with HMAC-Sha2 as the PRF (RFC 8018). The password is padded once, every
+// iteration then costs exactly two compressions and no allocation. Keys longer than
+// one digest are made of independent blocks which are derived in parallel on pool.
+// Returns false when iterations is zero or dkLen exceeds (2^32 - 1) digests
+template <HashType T>
+bool PBKDF2(ByteView password, ByteView salt, uint32_t iterations, uint8_t *derivedKey, size_t dkLen,
+            ThreadPool &pool = ThreadPool::Default())
+{
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+
+    size_t blocks = (dkLen + DigestSize - 1) / DigestSize;
+    if(iterations == 0 || static_cast<uint64_t>(blocks) > 0xffffffffULL)
+    {
+        return false;
+    }
+
+    HmacKey<T> key(password);
+    auto derive = [&](size_t begin, size_t end) {
+        uint8_t block[DigestSize];
+        for(size_t i = begin; i < end; i++)
+        {
+            detail::Pbkdf2Block<T>(key, salt, iterations, static_cast<uint32_t>(i + 1), block);
+            size_t offset = i * DigestSize;
+            std::copy(block, block + std::min(DigestSize, dkLen - offset), derivedKey + offset);
+        }
+    };
+
+    if(blocks > 1 && pool.Size() > 1)
+    {
+        pool.ParallelFor(blocks, 1, derive);
+    }
+    else
+    {
+        derive(0, blocks);
+    }
+    return true;
+}
+
+template <HashType T>
+std::vector<uint8_t> PBKDF2(ByteView password, ByteView salt, uint32_t iterations, size_t dkLen)
+{
+    std::vector<uint8_t> retval(dkLen);
+    if(!PBKDF2<T>(password, salt, iterations, retval.data(), dkLen))
+    {
+        return {};
+    }
+
+    return retval;
+}
+
+// HKDF-Extract of RFC 5869: prk = HMAC(salt, ikm), an empty salt stands for
+// DigestSize zero bytes. prk receives DigestSize bytes
+template <HashType T> void HKDF_Extract(ByteView salt, ByteView ikm, uint8_t *prk)
+{
+    static const uint8_t zeros[Sha2<T>::DigestSize] = {};
+
+    HmacKey<T> key(salt.size() > 0 ? salt : ByteView(zeros, sizeof(zeros)));
+    key.Mac(ikm, prk);
+}
+
+template <HashType T> std::vector<uint8_t> HKDF_Extract(ByteView salt, ByteView ikm)
+{
+    std::vector<uint8_t> retval(Sha2<T>::DigestSize);
+    HKDF_Extract<T>(salt, ikm, retval.data());
+    return retval;
+}
+
+// HKDF-Expand of RFC 5869, fills okm with length bytes derived from prk and info.
+// The prk is keyed once for all rounds and T(i) is written straight into okm, only a
+// trailing partial block goes through the stack. Returns false if length exceeds
+// 255 digests
+template <HashType T> bool HKDF_Expand(ByteView prk, ByteView info, uint8_t *okm, size_t length)
+{
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+
+    if(length > 255 * DigestSize)
+    {
+        return false;
+    }
+
+    Hmac<T> prf(prk);
+    uint8_t last[DigestSize];
+    for(size_t offset = 0, round = 1; offset < length; offset += DigestSize, round++)
+    {
+        const uint8_t counter = static_cast<uint8_t>(round);
+        if(offset > 0)
+        {
+            prf.Update(okm + offset - DigestSize, DigestSize);
+        }
+        prf.Update(info);
+        prf.Update(&counter, 1);
+
+        if(length - offset >= DigestSize)
+        {
+            prf.Final(okm + offset);
+        }
+        else
+        {
+            prf.Final(last);
+            std::copy(last, last + (length - offset), okm + offset);
+        }
+    }
+    return true;
+}
+
+template <HashType T> std::vector<uint8_t> HKDF_Expand(ByteView prk, ByteView info, size_t length)
+{
+    std::vector<uint8_t> retval(length);
+    if(!HKDF_Expand<T>(prk, info, retval.data(), length))
+    {
+        return {};
+    }
+
+    return retval;
+}
+
+// Extract followed by Expand
+template <HashType T> bool HKDF(ByteView salt, ByteView ikm, ByteView info, uint8_t *okm, size_t length)
+{
+    uint8_t prk[Sha2<T>::DigestSize];
+    HKDF_Extract<T>(salt, ikm, prk);
+    return HKDF_Expand<T>(ByteView(prk, sizeof(prk)), info, okm, length);
+}
+
+template <HashType T> std::vector<uint8_t> HKDF(ByteView salt, ByteView ikm, ByteView info, size_t length)
+{
+    std::vector<uint8_t> retval(length);
+    if(!HKDF<T>(salt, ikm, info, retval.data(), length))
+    {
+        return {};
+    }
+
+    return retval;
+}
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_KDF_H
@@ -0,0 +1,309 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_MERKLE_H
+#define SHA2_MERKLE_H
+
+#include "Sha2.h"
+#include "Sha2ThreadPool.h"
+
+namespace Sha2Cpp {
+
+// Merkle tree over leaf digests with incremental updates and inclusion proofs.
+//
+// The tree has the shape and the domain separation of RFC 6962 (Certificate Transparency),
+// levels are reduced pairwise and an odd node at the end of a level moves up unchanged:
+//   leaf  = H(0x00 || data)
+//   node  = H(0x01 || left || right)
+//   empty = H()
+// All levels are kept in one contiguous array, leaves first and the root last, so a level
+// is a plain run of digests and the children of a node are adjacent. Large levels are
+// hashed on a thread pool. Changing a leaf rehashes only the nodes on its path to the root
+template <HashType T> class MerkleTree {
+public:
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+    using Digest = typename Sha2<T>::Digest;
+
+    explicit MerkleTree(ThreadPool &pool = ThreadPool::Default()) : pool(pool) { Build(nullptr, 0); }
+
+    static void HashLeaf(ByteView data, uint8_t *digest)
+    {
+        Sha2<T> hasher;
+        hasher.Update(&leaf_prefix, 1);
+        hasher.Update(data);
+        hasher.Final(digest);
+    }
+
+    static Digest HashLeaf(ByteView data)
+    {
+        Digest digest;
+        HashLeaf(data, digest.data());
+        return digest;
+    }
+
+    // digest may point to left or right
+    static void HashNode(const uint8_t *left, const uint8_t *right, uint8_t *digest)
+    {
+        uint8_t node[1 + 2 * DigestSize];
+        node[0] = node_prefix;
+        std::copy(left, left + DigestSize, node + 1);
+        std::copy(right, right + DigestSize, node + 1 + DigestSize);
+        Sha2<T>::template HashFixed<1 + 2 * DigestSize>(node, digest);
+    }
+
+    // Builds the tree over count leaf digests (count * DigestSize bytes made by HashLeaf)
+    void Build(const uint8_t *leaves, size_t count)
+    {
+        Layout(count);
+        if(count > 0)
+        {
+            std::copy(leaves, leaves + count * DigestSize, nodes.data());
+        }
+        BuildLevels();
+    }
+
+    // Hashes count chunks into leaves and builds the tree, the leaves are hashed on the pool
+    void BuildFromChunks(const ByteView *chunks, size_t count)
+    {
+        Layout(count);
+        pool.ParallelFor(count, leaf_grain, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; i++)
+            {
+                HashLeaf(chunks[i], NodeAt(0, i));
+            }
+        });
+        BuildLevels();
+    }
+
+    size_t LeafCount() const { return levels.front().count; }
+
+    // number of levels including the leaves, 1 for trees of one leaf or none
+    size_t Height() const { return levels.size(); }
+
+    size_t LevelSize(size_t level) const { return levels[level].count; }
+
+    // digest of node index on level (0 is the leaves), no bounds checks
+    const uint8_t *Node(size_t level, size_t index) const
+    {
+        return nodes.data() + (levels[level].offset + index) * DigestSize;
+    }
+
+    const Digest &Root() const { return root; }
+
+    // Replaces leaf index and rehashes its path, throws std::out_of_range for a missing leaf
+    void UpdateLeaf(size_t index, const uint8_t *leaf)
+    {
+        CheckIndex(index);
+        std::copy(leaf, leaf + DigestSize, NodeAt(0, index));
+        for(size_t level = 1; level < levels.size(); level++)
+        {
+            index /= 2;
+            HashParent(level, index);
+        }
+        UpdateRoot();
+    }
+
+    // Replaces count leaves, leaf i gets the digest at leaves + i * DigestSize. A node shared
+    // by several changed paths is hashed once, large batches are hashed on the pool level by level.
+    // Throws std::out_of_range before anything is changed if an index is out of range
+    void UpdateLeaves(const size_t *indices, const uint8_t *leaves, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            CheckIndex(indices[i]);
+        }
+
+        std::vector<size_t> dirty(indices, indices + count);
+        for(size_t i = 0; i < count; i++)
+        {
+            std::copy(leaves + i * DigestSize, leaves + (i + 1) * DigestSize, NodeAt(0, indices[i]));
+        }
+
+        for(size_t level = 1; level < levels.size(); level++)
+        {
+            for(size_t &index : dirty)
+            {
+                index /= 2;
+            }
+            std::sort(dirty.begin(), dirty.end());
+            dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+            ForEach(dirty.size(), [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++)
+                {
+                    HashParent(level, dirty[i]);
+                }
+            });
+        }
+        UpdateRoot();
+    }
+
+    // Inclusion proof of leaf index: the sibling digests from the leaf level up, levels where
+    // the path node has no sibling are skipped. Throws std::out_of_range for a missing leaf
+    std::vector<uint8_t> Proof(size_t index) const
+    {
+        CheckIndex(index);
+        std::vector<uint8_t> proof;
+        for(size_t level = 0; level + 1 < levels.size(); level++, index /= 2)
+        {
+            size_t sibling = index ^ 1;
+            if(sibling < levels[level].count)
+            {
+                proof.insert(proof.end(), Node(level, sibling), Node(level, sibling) + DigestSize);
+            }
+        }
+        return proof;
+    }
+
+    // Checks that leaf is leaf index of a tree of leafCount leaves with the given root
+    static bool VerifyProof(ByteView root, const uint8_t *leaf, size_t index, size_t leafCount, ByteView proof)
+    {
+        if(index >= leafCount || root.size() != DigestSize)
+        {
+            return false;
+        }
+
+        uint8_t digest[DigestSize];
+        std::copy(leaf, leaf + DigestSize, digest);
+        size_t pos = 0;
+        for(size_t count = leafCount; count > 1; count = (count + 1) / 2, index /= 2)
+        {
+            if((index ^ 1) >= count)
+            {
+                continue;
+            }
+            if(proof.size() - pos < DigestSize)
+            {
+                return false;
+            }
+            const uint8_t *sibling = proof.data() + pos;
+            if(index & 1)
+            {
+                HashNode(sibling, digest, digest);
+            }
+            else
+            {
+                HashNode(digest, sibling, digest);
+            }
+            pos += DigestSize;
+        }
+        return pos == proof.size() && std::equal(digest, digest + DigestSize, root.data());
+    }
+
+private:
+    struct Level {
+        size_t offset;
+        size_t count;
+    };
+
+    static constexpr uint8_t leaf_prefix = 0x00;
+    static constexpr uint8_t node_prefix = 0x01;
+    // leaves and parent nodes per task, smaller runs are hashed on the calling thread
+    static constexpr size_t leaf_grain = 256;
+    static constexpr size_t level_grain = 4096;
+
+    ThreadPool &pool;
+    std::vector<Level> levels;
+    std::vector<uint8_t> nodes;
+    Digest root;
+
+    uint8_t *NodeAt(size_t level, size_t index) { return nodes.data() + (levels[level].offset + index) * DigestSize; }
+
+    void CheckIndex(size_t index) const
+    {
+        if(index >= LeafCount())
+        {
+            throw std::out_of_range("Sha2Cpp::MerkleTree: leaf index out of range");
+        }
+    }
+
+    void Layout(size_t count)
+    {
+        levels.assign(1, Level{0, count});
+        size_t total = count;
+        while(count > 1)
+        {
+            count = (count + 1) / 2;
+            levels.push_back(Level{total, count});
+            total += count;
+        }
+        nodes.resize(total * DigestSize);
+    }
+
+    template <typename F> void ForEach(size_t count, F body)
+    {
+        if(count <= level_grain)
+        {
+            body(0, count);
+            return;
+        }
+        pool.ParallelFor(count, level_grain, body);
+    }
+
+    void BuildLevels()
+    {
+        for(size_t level = 1; level < levels.size(); level++)
+        {
+            ForEach(levels[level].count, [&](size_t begin, size_t end) {
+                for(size_t i = begin; i < end; i++)
+                {
+                    HashParent(level, i);
+                }
+            });
+        }
+        UpdateRoot();
+    }
+
+    void HashParent(size_t level, size_t index)
+    {
+        const uint8_t *left = Node(level - 1, 2 * index);
+        if(2 * index + 1 == levels[level - 1].count)
+        {
+            std::copy(left, left + DigestSize, NodeAt(level, index));
+            return;
+        }
+        HashNode(left, left + DigestSize, NodeAt(level, index));
+    }
+
+    void UpdateRoot()
+    {
+        if(LeafCount() == 0)
+        {
+            Sha2<T>().Hash(ByteView(), root);
+            return;
+        }
+        const uint8_t *top = Node(levels.size() - 1, 0);
+        std::copy(top, top + DigestSize, root.begin());
+    }
+};
+
+template <HashType T> constexpr size_t MerkleTree<T>::DigestSize;
+template <HashType T> constexpr uint8_t MerkleTree<T>::leaf_prefix;
+template <HashType T> constexpr uint8_t MerkleTree<T>::node_prefix;
+template <HashType T> constexpr size_t MerkleTree<T>::leaf_grain;
+template <HashType T> constexpr size_t MerkleTree<T>::level_grain;
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_MERKLE_H
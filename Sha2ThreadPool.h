@@ -0,0 +1,255 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_THREAD_POOL_H
+#define SHA2_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Sha2Cpp {
+
+// Fixed size worker pool with one task deque per worker. A worker takes its own
+// newest task first and steals the oldest task of another worker when it runs dry,
+// so a burst of tasks submitted to one queue spreads over all workers
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+        : pending(0), next(0), stop(false)
+    {
+        threads = std::max<size_t>(threads, 1);
+        for(size_t i = 0; i < threads; i++)
+        {
+            queues.emplace_back(new Queue());
+        }
+        for(size_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back(&ThreadPool::Worker, this, i);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stop = true;
+        }
+        wakeup.notify_all();
+        for(auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t Size() const { return workers.size(); }
+
+    void Submit(std::function<void()> task)
+    {
+        // tasks submitted from a worker stay on its own queue, others are spread round robin
+        size_t index = CurrentWorker() != nullptr && CurrentWorker()->pool == this
+                           ? CurrentWorker()->index
+                           : next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending++;
+        }
+        wakeup.notify_one();
+    }
+
+    // Calls body(begin, end) over [0, count) split into ranges of at most grain items and
+    // returns once all of them are done. The calling thread runs queued tasks while it
+    // waits, so nested calls from inside a task cannot starve the pool. The first
+    // exception thrown by body is rethrown here
+    template <typename F> void ParallelFor(size_t count, size_t grain, F body)
+    {
+        if(count == 0)
+        {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+
+        std::atomic<size_t> remaining((count + grain - 1) / grain);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        for(size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = std::min(count, begin + grain);
+            Submit([&, begin, end]() {
+                try
+                {
+                    body(begin, end);
+                }
+                catch(...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                if(remaining.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex);
+                    wakeup.notify_all();
+                }
+            });
+        }
+
+        while(remaining.load() > 0)
+        {
+            if(!TryRun())
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wakeup.wait(lock, [&]() { return remaining.load() == 0 || pending > 0; });
+            }
+        }
+
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Process wide pool with one worker per hardware thread
+    static ThreadPool &Default()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct WorkerInfo {
+        ThreadPool *pool;
+        size_t index;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+    // queued tasks not taken yet, may dip below zero when a task is taken before it is counted
+    long pending;
+    std::atomic<size_t> next;
+    bool stop;
+
+    static WorkerInfo *&CurrentWorker()
+    {
+        static thread_local WorkerInfo *current = nullptr;
+        return current;
+    }
+
+    bool Take(size_t index, bool own, std::function<void()> &task)
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        std::deque<std::function<void()>> &tasks = queues[index]->tasks;
+        if(tasks.empty())
+        {
+            return false;
+        }
+        if(own)
+        {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        return true;
+    }
+
+    // runs one queued task, own queue first, then stealing from the others
+    bool TryRun()
+    {
+        size_t self = CurrentWorker() != nullptr && CurrentWorker()->pool == this ? CurrentWorker()->index
+                                                                                  : queues.size();
+        std::function<void()> task;
+        bool found = self < queues.size() && Take(self, true, task);
+        for(size_t i = 1; !found && i <= queues.size(); i++)
+        {
+            size_t victim = (self + i) % queues.size();
+            found = victim != self && Take(victim, false, task);
+        }
+        if(!found)
+        {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pending--;
+        }
+        task();
+        return true;
+    }
+
+    void Worker(size_t index)
+    {
+        WorkerInfo info = {this, index};
+        CurrentWorker() = &info;
+
+        for(;;)
+        {
+            if(TryRun())
+            {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeup.wait(lock, [this]() { return stop || pending > 0; });
+            if(stop && pending <= 0)
+            {
+                break;
+            }
+        }
+
+        CurrentWorker() = nullptr;
+    }
+};
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_THREAD_POOL_H
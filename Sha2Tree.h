@@ -0,0 +1,142 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SHA2_TREE_H
+#define SHA2_TREE_H
+
+#include "Sha2.h"
+#include "Sha2ThreadPool.h"
+
+namespace Sha2Cpp {
+
+// Parallel tree hash. NOTE: this is NOT a standard Sha2 digest of the data, it only
+// matches itself for the same hash type and chunk size.
+//
+// The input is cut into chunkSize leaves (the last one may be shorter, empty input is
+// a single empty leaf) and reduced pairwise, an odd node at the end of a level moves up
+// unchanged:
+//   leaf   = H(0x00 || chunk)
+//   node   = H(0x01 || left || right)
+//   digest = H(0x02 || chunkSize || length || top node), both sizes as 64 bit big endian
+// Leaves and large levels are hashed on a thread pool, so the wall clock time scales
+// with the number of workers
+template <HashType T> class TreeHash {
+public:
+    static constexpr size_t DigestSize = Sha2<T>::DigestSize;
+    static constexpr size_t DefaultChunkSize = 1 << 20;
+
+    explicit TreeHash(size_t chunkSize = DefaultChunkSize, ThreadPool &pool = ThreadPool::Default())
+        : chunkSize(std::max<size_t>(chunkSize, 1)), pool(pool)
+    {
+    }
+
+    size_t ChunkSize() const { return chunkSize; }
+
+    std::vector<uint8_t> Hash(ByteView data)
+    {
+        std::vector<uint8_t> retval(DigestSize);
+        Hash(data, retval.data());
+        return retval;
+    }
+
+    void Hash(ByteView data, uint8_t *digest)
+    {
+        size_t count = std::max<size_t>((data.size() + chunkSize - 1) / chunkSize, 1);
+        std::vector<uint8_t> level(count * DigestSize);
+
+        pool.ParallelFor(count, std::max<size_t>(task_bytes / chunkSize, 1), [&](size_t begin, size_t end) {
+            Sha2<T> hasher;
+            for(size_t i = begin; i < end; i++)
+            {
+                size_t offset = i * chunkSize;
+                size_t length = std::min(chunkSize, data.size() - std::min(offset, data.size()));
+                hasher.Init();
+                hasher.Update(&leaf_prefix, 1);
+                hasher.Update(data.data() + offset, length);
+                hasher.Final(&level[i * DigestSize]);
+            }
+        });
+
+        while(count > 1)
+        {
+            size_t parents = (count + 1) / 2;
+            std::vector<uint8_t> up(parents * DigestSize);
+
+            pool.ParallelFor(parents, level_grain, [&](size_t begin, size_t end) {
+                Sha2<T> hasher;
+                for(size_t i = begin; i < end; i++)
+                {
+                    if(2 * i + 1 == count)
+                    {
+                        std::copy(&level[2 * i * DigestSize], &level[2 * i * DigestSize] + DigestSize,
+                                  &up[i * DigestSize]);
+                        continue;
+                    }
+                    hasher.Init();
+                    hasher.Update(&node_prefix, 1);
+                    hasher.Update(&level[2 * i * DigestSize], 2 * DigestSize);
+                    hasher.Final(&up[i * DigestSize]);
+                }
+            });
+
+            level.swap(up);
+            count = parents;
+        }
+
+        uint8_t header[1 + 2 * sizeof(uint64_t)] = {root_prefix};
+        for(size_t i = 0; i < sizeof(uint64_t); i++)
+        {
+            header[sizeof(uint64_t) - i] = static_cast<uint8_t>(static_cast<uint64_t>(chunkSize) >> (i * 8));
+            header[2 * sizeof(uint64_t) - i] = static_cast<uint8_t>(static_cast<uint64_t>(data.size()) >> (i * 8));
+        }
+
+        Sha2<T> hasher;
+        hasher.Update(header, sizeof(header));
+        hasher.Update(level.data(), DigestSize);
+        hasher.Final(digest);
+    }
+
+private:
+    static constexpr uint8_t leaf_prefix = 0x00;
+    static constexpr uint8_t node_prefix = 0x01;
+    static constexpr uint8_t root_prefix = 0x02;
+    // input bytes per leaf task and parent nodes per level task
+    static constexpr size_t task_bytes = 1 << 18;
+    static constexpr size_t level_grain = 4096;
+
+    size_t chunkSize;
+    ThreadPool &pool;
+};
+
+template <HashType T> constexpr size_t TreeHash<T>::DigestSize;
+template <HashType T> constexpr size_t TreeHash<T>::DefaultChunkSize;
+template <HashType T> constexpr uint8_t TreeHash<T>::leaf_prefix;
+template <HashType T> constexpr uint8_t TreeHash<T>::node_prefix;
+template <HashType T> constexpr uint8_t TreeHash<T>::root_prefix;
+template <HashType T> constexpr size_t TreeHash<T>::task_bytes;
+template <HashType T> constexpr size_t TreeHash<T>::level_grain;
+
+} // namespace Sha2Cpp
+
+#endif // SHA2_TREE_H
@@ -0,0 +1,318 @@
+/*
+ *
+ * Copyright (c) 2022 ruslan@muhlinin.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+// Throughput and latency of the single-shot Hash and HMAC paths for every compiled-in
+// hash type, message size and backend, written to stdout as JSON:
+//
+//   sha2cpp_bench [--max-size=BYTES] [--min-time=SECONDS] [--filter=TEXT]
+//
+// Each case is timed over enough iterations to run for min-time (at least one), the
+// best of three repetitions is reported, also when a single call exceeds min-time. cycles_per_byte counts time stamp counter
+// ticks and is null where no such counter is available
+
+#include "Sha2.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(SHA2CPP_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(SHA2CPP_X86)
+#include <x86intrin.h>
+#endif
+
+using Operation = std::function<void(Sha2Cpp::ByteView message, uint8_t *digest)>;
+
+struct Algorithm
+{
+    std::string name;
+    Operation hash;
+    Operation hmac;
+};
+
+template <Sha2Cpp::HashType T> static Algorithm makeAlgorithm(const std::string &name)
+{
+    std::shared_ptr<Sha2Cpp::Sha2<T>> hasher = std::make_shared<Sha2Cpp::Sha2<T>>();
+    std::shared_ptr<Sha2Cpp::HmacKey<T>> key = std::make_shared<Sha2Cpp::HmacKey<T>>("benchmark key");
+    return {name, [hasher](Sha2Cpp::ByteView message, uint8_t *digest) { hasher->Hash(message, digest); },
+            [key](Sha2Cpp::ByteView message, uint8_t *digest) { key->Mac(message, digest); }};
+}
+
+static std::vector<Algorithm> algorithms()
+{
+    std::vector<Algorithm> list;
+#ifdef WITH_SHA256
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha256>("Sha256"));
+#endif
+#ifdef WITH_SHA224
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha224>("Sha224"));
+#endif
+#ifdef WITH_SHA512
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha512>("Sha512"));
+#endif
+#ifdef WITH_SHA384
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha384>("Sha384"));
+#endif
+#ifdef WITH_SHA512_256
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha512_256>("Sha512_256"));
+#endif
+#ifdef WITH_SHA512_224
+    list.push_back(makeAlgorithm<Sha2Cpp::HashType::Sha512_224>("Sha512_224"));
+#endif
+    return list;
+}
+
+struct Backend
+{
+    std::string name;
+    Sha2Cpp::CpuFeatures features;
+};
+
+// new backends get an entry here, each one is selected by forcing the feature flags
+static std::vector<Backend> backends(const Sha2Cpp::CpuFeatures &detected)
+{
+    std::vector<Backend> list;
+    list.push_back({"native", detected});
+    if (detected.x86Sha || detected.avx2 || detected.avx512 || detected.armSha2 || detected.armSha512)
+    {
+        list.push_back({"portable", Sha2Cpp::CpuFeatures()});
+    }
+    return list;
+}
+
+static uint64_t cycles()
+{
+#ifdef SHA2CPP_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct Sample
+{
+    uint64_t iterations;
+    double seconds;
+    uint64_t cycles;
+};
+
+static Sample measure(const Operation &operation, Sha2Cpp::ByteView message, uint64_t iterations)
+{
+    uint8_t digest[64];
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = cycles();
+    for (uint64_t n = 0; n < iterations; n++)
+    {
+        operation(message, digest);
+    }
+    uint64_t endCycles = cycles();
+    auto end = std::chrono::steady_clock::now();
+
+    // keep the digest observable so the calls cannot be dropped
+    volatile uint8_t sink = digest[0];
+    (void)sink;
+    return {iterations, std::chrono::duration<double>(end - start).count(), endCycles - startCycles};
+}
+
+static Sample run(const Operation &operation, Sha2Cpp::ByteView message, double minTime)
+{
+    // a single call sizes the repetitions and warms up caches, it is not reported
+    Sample best = measure(operation, message, 1);
+    uint64_t iterations = static_cast<uint64_t>(minTime / std::max(best.seconds, 1e-9)) + 1;
+    for (int repetition = 0; repetition < 3; repetition++)
+    {
+        Sample sample = measure(operation, message, iterations);
+        if (repetition == 0 || sample.seconds / sample.iterations < best.seconds / best.iterations)
+        {
+            best = sample;
+        }
+    }
+    return best;
+}
+
+static std::string number(double value)
+{
+    char text[64];
+    std::snprintf(text, sizeof(text), "%.6g", value);
+    return text;
+}
+
+// accepts a byte count with an optional K, M or G suffix, false for anything else
+static bool parseSize(const std::string &text, uint64_t &size)
+{
+    char *end = nullptr;
+    uint64_t value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || !std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+
+    unsigned shift = 0;
+    switch (*end)
+    {
+    case '\0':
+        break;
+    case 'K':
+    case 'k':
+        shift = 10;
+        break;
+    case 'M':
+    case 'm':
+        shift = 20;
+        break;
+    case 'G':
+    case 'g':
+        shift = 30;
+        break;
+    default:
+        return false;
+    }
+    if (shift != 0 && end[1] != '\0')
+    {
+        return false;
+    }
+
+    size = value << shift;
+    return true;
+}
+
+static int usage(const char *program)
+{
+    std::fprintf(stderr, "usage: %s [--max-size=BYTES[K|M|G]] [--min-time=SECONDS] [--filter=TEXT]\n", program);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t maxSize = 1ull << 30;
+    double minTime = 0.2;
+    std::string filter;
+    for (int n = 1; n < argc; n++)
+    {
+        std::string arg = argv[n];
+        if (arg.compare(0, 11, "--max-size=") == 0)
+        {
+            if (!parseSize(arg.substr(11), maxSize))
+            {
+                return usage(argv[0]);
+            }
+        }
+        else if (arg.compare(0, 11, "--min-time=") == 0)
+        {
+            minTime = std::atof(arg.c_str() + 11);
+        }
+        else if (arg.compare(0, 9, "--filter=") == 0)
+        {
+            filter = arg.substr(9);
+        }
+        else
+        {
+            return usage(argv[0]);
+        }
+    }
+
+    std::vector<uint64_t> sizes = {0, 64, 256};
+    for (uint64_t size = 1 << 10; size <= (1ull << 30); size <<= 2)
+    {
+        sizes.push_back(size);
+    }
+
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min(maxSize, sizes.back())));
+    for (size_t n = 0; n < buffer.size(); n++)
+    {
+        buffer[n] = static_cast<uint8_t>(n * 131 + (n >> 12));
+    }
+
+    Sha2Cpp::CpuFeatures detected = Sha2Cpp::CpuFeatures::Get();
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    std::printf("{\n  \"context\": {\n");
+    std::printf("    \"date\": \"%s\",\n", date);
+    std::printf("    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    std::printf("    \"x86_sha\": %s,\n", detected.x86Sha ? "true" : "false");
+    std::printf("    \"avx2\": %s,\n", detected.avx2 ? "true" : "false");
+    std::printf("    \"avx512\": %s,\n", detected.avx512 ? "true" : "false");
+    std::printf("    \"arm_sha2\": %s,\n", detected.armSha2 ? "true" : "false");
+    std::printf("    \"arm_sha512\": %s,\n", detected.armSha512 ? "true" : "false");
+    std::printf("    \"min_time\": %s\n", number(minTime).c_str());
+    std::printf("  },\n  \"benchmarks\": [");
+
+    const char *separator = "\n";
+    for (auto const &backend : backends(detected))
+    {
+        Sha2Cpp::CpuFeatures::Override(backend.features);
+        for (auto const &algorithm : algorithms())
+        {
+            for (int op = 0; op < 2; op++)
+            {
+                const char *operation = op == 0 ? "Hash" : "HMAC";
+                for (uint64_t size : sizes)
+                {
+                    if (size > maxSize)
+                    {
+                        break;
+                    }
+
+                    std::string name = std::string(operation) + "/" + algorithm.name + "/" + std::to_string(size)
+                                       + "/" + backend.name;
+                    if (name.find(filter) == std::string::npos)
+                    {
+                        continue;
+                    }
+
+                    Sample sample = run(op == 0 ? algorithm.hash : algorithm.hmac,
+                                        Sha2Cpp::ByteView(buffer.data(), static_cast<size_t>(size)), minTime);
+                    double perOp = sample.seconds / sample.iterations;
+                    double cyclesPerOp = static_cast<double>(sample.cycles) / sample.iterations;
+
+                    std::printf("%s    {\"name\": \"%s\", \"operation\": \"%s\", \"algorithm\": \"%s\", "
+                                "\"backend\": \"%s\", \"bytes\": %llu, \"iterations\": %llu, \"ns_per_op\": %s, "
+                                "\"gb_per_second\": %s, \"cycles_per_byte\": %s}",
+                                separator, name.c_str(), operation, algorithm.name.c_str(), backend.name.c_str(),
+                                static_cast<unsigned long long>(size),
+                                static_cast<unsigned long long>(sample.iterations), number(perOp * 1e9).c_str(),
+                                size > 0 ? number(size / perOp / 1e9).c_str() : "null",
+                                size > 0 && sample.cycles > 0 ? number(cyclesPerOp / size).c_str() : "null");
+                    std::fflush(stdout);
+                    separator = ",\n";
+                }
+            }
+        }
+    }
+    Sha2Cpp::CpuFeatures::Override(detected);
+
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
@@ -23,7 +23,252 @@
  */
 
 #include "Sha2.h"
+#include "Sha2Batch.h"
+#include "Sha2Cache.h"
+#include "Sha2Dedup.h"
+#include "Sha2Encoding.h"
+#include "Sha2File.h"
+#include "Sha2Kdf.h"
+#include "Sha2Merkle.h"
+#include "Sha2Tree.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <thread>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#ifdef SHA2CPP_POSIX
+#include <sys/time.h>
+#endif
+
+template <Sha2Cpp::HashType T>
+static std::vector<uint8_t> hashStreaming(Sha2Cpp::Sha2<T> &hasher, const std::string &data, size_t chunk)
+{
+    hasher.Init();
+    for (size_t pos = 0; pos < data.size(); pos += chunk)
+    {
+        size_t length = std::min(chunk, data.size() - pos);
+        hasher.Update(reinterpret_cast<const uint8_t *>(data.data()) + pos, length);
+    }
+
+    return hasher.Final();
+}
+
+template <Sha2Cpp::HashType T>
+static std::vector<uint8_t> hashInto(Sha2Cpp::Sha2<T> &hasher, const std::string &data)
+{
+    typename Sha2Cpp::Sha2<T>::Digest digest;
+    hasher.Hash(data, digest);
+
+    return std::vector<uint8_t>(digest.begin(), digest.end());
+}
+
+template <Sha2Cpp::HashType T>
+static std::vector<std::vector<uint8_t>> hashMany(Sha2Cpp::Sha2<T> &hasher, const std::vector<std::string> &data)
+{
+    std::vector<const uint8_t *> msgs;
+    std::vector<size_t> lens;
+    for (auto const &str : data)
+    {
+        msgs.push_back(reinterpret_cast<const uint8_t *>(str.data()));
+        lens.push_back(str.size());
+    }
+
+    std::vector<uint8_t> out(data.size() * hasher.DigestSize);
+    hasher.HashMany(msgs.data(), lens.data(), data.size(), out.data());
+
+    std::vector<std::vector<uint8_t>> hashes;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        hashes.emplace_back(out.begin() + i * hasher.DigestSize, out.begin() + (i + 1) * hasher.DigestSize);
+    }
+
+    return hashes;
+}
+
+// prk followed by okm, empty if the combined HKDF() disagrees with the two steps
+template <Sha2Cpp::HashType T>
+static std::vector<uint8_t> hkdf(const std::string &salt, const std::string &ikm, const std::string &info,
+                                 size_t length)
+{
+    std::vector<uint8_t> out = Sha2Cpp::HKDF_Extract<T>(salt, ikm);
+    std::vector<uint8_t> okm = Sha2Cpp::HKDF_Expand<T>(out, info, length);
+    if (Sha2Cpp::HKDF<T>(salt, ikm, info, length) != okm)
+    {
+        return {};
+    }
+    out.insert(out.end(), okm.begin(), okm.end());
+    return out;
+}
+
+// hashes data[0, split), exports the state and finishes on a context restored from it
+// and on a clone of that, both digests must agree
+template <Sha2Cpp::HashType T> static std::vector<uint8_t> hashResumed(const std::string &data, size_t split)
+{
+    Sha2Cpp::Sha2<T> prefix;
+    prefix.Update(data.data(), split);
+    std::vector<uint8_t> saved = prefix.Export();
+
+    Sha2Cpp::Sha2<T> resumed;
+    if (saved.size() > Sha2Cpp::Sha2<T>::MaxExportSize || !resumed.Import(saved))
+    {
+        return {};
+    }
+    Sha2Cpp::Sha2<T> fork = resumed.Clone();
+
+    resumed.Update(data.data() + split, data.size() - split);
+    fork.Update(data.data() + split, data.size() - split);
+    std::vector<uint8_t> digest = resumed.Final();
+    return digest == fork.Final() ? digest : std::vector<uint8_t>();
+}
+
+// the same streaming and resume paths through a Hasher selected at runtime, the fork is a plain copy
+static std::vector<uint8_t> hasherStreaming(Sha2Cpp::HashType type, const std::string &data, size_t chunk)
+{
+    Sha2Cpp::Hasher hasher(type);
+    for (size_t pos = 0; pos < data.size(); pos += chunk)
+    {
+        size_t length = std::min(chunk, data.size() - pos);
+        hasher.Update(reinterpret_cast<const uint8_t *>(data.data()) + pos, length);
+    }
+
+    return hasher.Final();
+}
+
+static std::vector<uint8_t> hasherResumed(Sha2Cpp::HashType type, const std::string &data, size_t split)
+{
+    Sha2Cpp::Hasher prefix(type);
+    prefix.Update(data.data(), split);
+    std::vector<uint8_t> saved = prefix.Export();
+
+    Sha2Cpp::Hasher resumed(type);
+    if (saved.size() > resumed.MaxExportSize() || !resumed.Import(saved))
+    {
+        return {};
+    }
+    Sha2Cpp::Hasher fork = resumed;
+
+    resumed.Update(data.data() + split, data.size() - split);
+    fork.Update(data.data() + split, data.size() - split);
+    std::vector<uint8_t> digest = resumed.Final();
+    return digest == fork.Final() ? digest : std::vector<uint8_t>();
+}
+
+#ifdef WITH_SHA256
+// straightforward sequential evaluation of the tree hash layout
+static std::vector<uint8_t> treeReference(const std::string &data, size_t chunkSize)
+{
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hasher;
+    std::vector<std::vector<uint8_t>> level;
+    for (size_t pos = 0; pos < data.size() || level.empty(); pos += chunkSize)
+    {
+        level.push_back(hasher.Hash(std::string(1, '\x00') + data.substr(pos, chunkSize)));
+    }
+
+    while (level.size() > 1)
+    {
+        std::vector<std::vector<uint8_t>> up;
+        for (size_t i = 0; i < level.size(); i += 2)
+        {
+            if (i + 1 == level.size())
+            {
+                up.push_back(level[i]);
+                continue;
+            }
+            std::vector<uint8_t> node(1, 0x01);
+            node.insert(node.end(), level[i].begin(), level[i].end());
+            node.insert(node.end(), level[i + 1].begin(), level[i + 1].end());
+            up.push_back(hasher.Hash(node));
+        }
+        level.swap(up);
+    }
+
+    std::vector<uint8_t> root(17, 0);
+    root[0] = 0x02;
+    for (size_t i = 0; i < 8; i++)
+    {
+        root[8 - i] = static_cast<uint8_t>(static_cast<uint64_t>(chunkSize) >> (i * 8));
+        root[16 - i] = static_cast<uint8_t>(static_cast<uint64_t>(data.size()) >> (i * 8));
+    }
+    root.insert(root.end(), level[0].begin(), level[0].end());
+
+    return hasher.Hash(root);
+}
+// Merkle tree hash as defined recursively by RFC 6962, splits at the largest power of two below n
+static std::vector<uint8_t> merkleReference(const std::vector<std::string> &leaves, size_t begin, size_t end)
+{
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hasher;
+    if (begin == end)
+    {
+        return hasher.Hash("");
+    }
+    if (end - begin == 1)
+    {
+        return hasher.Hash(std::string(1, '\x00') + leaves[begin]);
+    }
+
+    size_t split = 1;
+    while (split * 2 < end - begin)
+    {
+        split *= 2;
+    }
+    std::vector<uint8_t> node(1, 0x01);
+    std::vector<uint8_t> left = merkleReference(leaves, begin, begin + split);
+    std::vector<uint8_t> right = merkleReference(leaves, begin + split, end);
+    node.insert(node.end(), left.begin(), left.end());
+    node.insert(node.end(), right.begin(), right.end());
+    return hasher.Hash(node);
+}
+#endif
+
+// HashFixed<N> and DoubleHash<N> against the general path for lengths around the padding
+// boundaries of both block sizes, returns the number of lengths that disagree
+template <Sha2Cpp::HashType T> static size_t fixedLengthMismatches()
+{
+    typedef Sha2Cpp::Sha2<T> Sha;
+    std::vector<uint8_t> data(200);
+    for (size_t n = 0; n < data.size(); n++)
+    {
+        data[n] = static_cast<uint8_t>(n * 13 + 5);
+    }
+
+    Sha hasher;
+    std::vector<std::pair<size_t, typename Sha::Digest>> fixed = {
+        {0, Sha::template HashFixed<0>(data.data())},     {1, Sha::template HashFixed<1>(data.data())},
+        {32, Sha::template HashFixed<32>(data.data())},   {55, Sha::template HashFixed<55>(data.data())},
+        {56, Sha::template HashFixed<56>(data.data())},   {64, Sha::template HashFixed<64>(data.data())},
+        {111, Sha::template HashFixed<111>(data.data())}, {112, Sha::template HashFixed<112>(data.data())},
+        {128, Sha::template HashFixed<128>(data.data())}, {200, Sha::template HashFixed<200>(data.data())}};
+
+    size_t mismatches = 0;
+    for (auto const &entry : fixed)
+    {
+        std::vector<uint8_t> expected = hasher.Hash(data.data(), entry.first);
+        mismatches += std::equal(expected.begin(), expected.end(), entry.second.begin()) ? 0 : 1;
+    }
+
+    std::array<uint8_t, 64> node;
+    std::copy(data.begin(), data.begin() + node.size(), node.begin());
+    typename Sha::Digest doubled;
+    Sha::template DoubleHash<64>(node.data(), doubled.data());
+    mismatches += (doubled == Sha::DoubleHash(node) && Sha::HashFixed(node) == fixed[5].second) ? 0 : 1;
+    return mismatches;
+}
+
+// a context is only its chaining values, one block and the length counter
+#ifdef WITH_SHA256
+static_assert(sizeof(Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256>) == 8 * 4 + 64 + 8, "Sha256 context size");
+static_assert(std::is_trivially_copyable<Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256>>::value, "Sha256 context copy");
+#endif
+#ifdef WITH_SHA512
+static_assert(sizeof(Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512>) == 8 * 8 + 128 + 8, "Sha512 context size");
+static_assert(std::is_trivially_copyable<Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512>>::value, "Sha512 context copy");
+#endif
 
 struct TestInstance
 {
@@ -62,6 +307,111 @@ struct TestInstance
         return {};
     }
 
+    std::vector<uint8_t> HashStreaming(Sha2Cpp::HashType type, const std::string &data, size_t chunk)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return hashStreaming(hash256, data, chunk);
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+            return hashStreaming(hash224, data, chunk);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return hashStreaming(hash512, data, chunk);
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+            return hashStreaming(hash384, data, chunk);
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return hashStreaming(hash512_256, data, chunk);
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return hashStreaming(hash512_224, data, chunk);
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+
+    std::vector<std::vector<uint8_t>> HashMany(Sha2Cpp::HashType type, const std::vector<std::string> &data)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return hashMany(hash256, data);
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+            return hashMany(hash224, data);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return hashMany(hash512, data);
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+            return hashMany(hash384, data);
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return hashMany(hash512_256, data);
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return hashMany(hash512_224, data);
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+
+    std::vector<uint8_t> HashInto(Sha2Cpp::HashType type, const std::string &data)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return hashInto(hash256, data);
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+            return hashInto(hash224, data);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return hashInto(hash512, data);
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+            return hashInto(hash384, data);
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return hashInto(hash512_256, data);
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return hashInto(hash512_224, data);
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+
     std::vector<uint8_t> HMAC(Sha2Cpp::HashType type, const std::string &data, const std::string &key)
     {
         switch (type)
@@ -97,50 +447,248 @@ struct TestInstance
         return {};
     }
 
+    size_t FixedLengthMismatches(Sha2Cpp::HashType type)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha256>();
+#endif
 #ifdef WITH_SHA224
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha224> hash224;
+        case Sha2Cpp::HashType::Sha224:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha224>();
 #endif
-#ifdef WITH_SHA256
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hash256;
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha512>();
 #endif
 #ifdef WITH_SHA384
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha384> hash384;
+        case Sha2Cpp::HashType::Sha384:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha384>();
 #endif
-#ifdef WITH_SHA512
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512> hash512;
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha512_256>();
 #endif
 #ifdef WITH_SHA512_224
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_224> hash512_224;
+        case Sha2Cpp::HashType::Sha512_224:
+            return fixedLengthMismatches<Sha2Cpp::HashType::Sha512_224>();
+#endif
+        default:
+            break;
+        }
+
+        return 1;
+    }
+
+    std::vector<uint8_t> HashResumed(Sha2Cpp::HashType type, const std::string &data, size_t split)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return hashResumed<Sha2Cpp::HashType::Sha256>(data, split);
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+            return hashResumed<Sha2Cpp::HashType::Sha224>(data, split);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return hashResumed<Sha2Cpp::HashType::Sha512>(data, split);
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+            return hashResumed<Sha2Cpp::HashType::Sha384>(data, split);
 #endif
 #ifdef WITH_SHA512_256
-    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_256> hash512_256;
+        case Sha2Cpp::HashType::Sha512_256:
+            return hashResumed<Sha2Cpp::HashType::Sha512_256>(data, split);
 #endif
-} testInstances;
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return hashResumed<Sha2Cpp::HashType::Sha512_224>(data, split);
+#endif
+        default:
+            break;
+        }
 
-struct TestCase
-{
-    Sha2Cpp::HashType type;
-    std::string name;
-    std::string str;
-    std::string sample;
-    std::string key;
-};
+        return {};
+    }
 
-std::vector<TestCase> testCases = {
+    std::vector<uint8_t> PBKDF2(Sha2Cpp::HashType type, const std::string &password, const std::string &salt,
+                                uint32_t iterations, size_t length)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha256>(password, salt, iterations, length);
+#endif
 #ifdef WITH_SHA224
-    {Sha2Cpp::HashType::Sha224, "Sha224 empty string", "", "d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f"},
-    {Sha2Cpp::HashType::Sha224,
-     "Sha224 long string",
-     "01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghij"
-     "klmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz012345"
-     "67890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnop"
-     "qrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz",
-     "f7c057c13f78cd64044e92c7f7b3fa07fba6138ff0058ce78e9343f7"},
-    {Sha2Cpp::HashType::Sha224, "Sha224 short string", "abc", "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7"},
+        case Sha2Cpp::HashType::Sha224:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha224>(password, salt, iterations, length);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha512>(password, salt, iterations, length);
 #endif
 #ifdef WITH_SHA384
-    {Sha2Cpp::HashType::Sha384,
-     "Sha384 empty string",
+        case Sha2Cpp::HashType::Sha384:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha384>(password, salt, iterations, length);
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha512_256>(password, salt, iterations, length);
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return Sha2Cpp::PBKDF2<Sha2Cpp::HashType::Sha512_224>(password, salt, iterations, length);
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+
+    // returns PRK || OKM
+    std::vector<uint8_t> HKDF(Sha2Cpp::HashType type, const std::string &salt, const std::string &ikm,
+                              const std::string &info, size_t length)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+            return hkdf<Sha2Cpp::HashType::Sha256>(salt, ikm, info, length);
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+            return hkdf<Sha2Cpp::HashType::Sha224>(salt, ikm, info, length);
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+            return hkdf<Sha2Cpp::HashType::Sha512>(salt, ikm, info, length);
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+            return hkdf<Sha2Cpp::HashType::Sha384>(salt, ikm, info, length);
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+            return hkdf<Sha2Cpp::HashType::Sha512_256>(salt, ikm, info, length);
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+            return hkdf<Sha2Cpp::HashType::Sha512_224>(salt, ikm, info, length);
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+
+#ifdef SHA2CPP_CONSTEXPR_HASH
+    std::vector<uint8_t> ConstexprHash(Sha2Cpp::HashType type, std::string_view data)
+    {
+        switch (type)
+        {
+#ifdef WITH_SHA256
+        case Sha2Cpp::HashType::Sha256:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+#ifdef WITH_SHA224
+        case Sha2Cpp::HashType::Sha224:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha224>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+#ifdef WITH_SHA512
+        case Sha2Cpp::HashType::Sha512:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+#ifdef WITH_SHA384
+        case Sha2Cpp::HashType::Sha384:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha384>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+#ifdef WITH_SHA512_256
+        case Sha2Cpp::HashType::Sha512_256:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_256>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+#ifdef WITH_SHA512_224
+        case Sha2Cpp::HashType::Sha512_224:
+        {
+            auto digest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_224>::ConstexprHash(data);
+            return std::vector<uint8_t>(digest.begin(), digest.end());
+        }
+#endif
+        default:
+            break;
+        }
+
+        return {};
+    }
+#endif
+
+#ifdef WITH_SHA224
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha224> hash224;
+#endif
+#ifdef WITH_SHA256
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hash256;
+#endif
+#ifdef WITH_SHA384
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha384> hash384;
+#endif
+#ifdef WITH_SHA512
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512> hash512;
+#endif
+#ifdef WITH_SHA512_224
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_224> hash512_224;
+#endif
+#ifdef WITH_SHA512_256
+    Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha512_256> hash512_256;
+#endif
+} testInstances;
+
+struct TestCase
+{
+    Sha2Cpp::HashType type;
+    std::string name;
+    std::string str;
+    std::string sample;
+    std::string key;
+};
+
+std::vector<TestCase> testCases = {
+#ifdef WITH_SHA224
+    {Sha2Cpp::HashType::Sha224, "Sha224 empty string", "", "d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f"},
+    {Sha2Cpp::HashType::Sha224,
+     "Sha224 long string",
+     "01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghij"
+     "klmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz012345"
+     "67890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnop"
+     "qrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz01234567890abcdefghijklmnopqrsuvwxyz",
+     "f7c057c13f78cd64044e92c7f7b3fa07fba6138ff0058ce78e9343f7"},
+    {Sha2Cpp::HashType::Sha224, "Sha224 short string", "abc", "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7"},
+#endif
+#ifdef WITH_SHA384
+    {Sha2Cpp::HashType::Sha384,
+     "Sha384 empty string",
      "",
      "38b060a751ac96384cd9327eb1b1e36a21fdb71114be07434c0cc7bf63f6e1da274edebfe76f65fbd51ad2f14898b"
      "95b"},
@@ -174,6 +722,10 @@ std::vector<TestCase> testCases = {
      "Sha256 short string",
      "abc",
      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {Sha2Cpp::HashType::Sha256,
+     "Sha256 two block padding",
+     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
 #endif
 #ifdef WITH_SHA512
     {Sha2Cpp::HashType::Sha512,
@@ -194,6 +746,12 @@ std::vector<TestCase> testCases = {
      "abc",
      "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3fee"
      "bbd454d4423643ce80e2a9ac94fa54ca49f"},
+    {Sha2Cpp::HashType::Sha512,
+     "Sha512 two block padding",
+     "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+     "nopqrstu",
+     "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018501d289e4900f7e4331b99dec4b5433ac7d329eeb"
+     "6dd26545e96e55b874be909"},
 #endif
 #ifdef WITH_SHA512_224
     {Sha2Cpp::HashType::Sha512_224,
@@ -360,6 +918,342 @@ std::vector<TestCase> testCases_HMAC = {
 #endif
 };
 
+// RFC 4231 HMAC test vectors, data and key are hex encoded, test case 5 is truncated to 128 bits
+std::vector<TestCase> testCases_RFC4231 = {
+#ifdef WITH_SHA224
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 1 HMAC-SHA-224",
+     "4869205468657265",
+     "896fb1128abbdf196832107cd49df33f47b4b1169912ba4f53684b22",
+     "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 2 HMAC-SHA-224",
+     "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+     "a30e01098bc6dbbf45690f3a7e9e6d0f8bbea2a39e6148008fd05e44",
+     "4a656665"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 3 HMAC-SHA-224",
+     "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+     "dddddddd",
+     "7fb3cb3588c6c1f6ffa9694d7d6ad2649365b0c1f65d69d1ec8333ea",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 4 HMAC-SHA-224",
+     "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+     "cdcdcdcd",
+     "6c11506874013cac6a2abc1bb382627cec6a90d86efc012de7afec5a",
+     "0102030405060708090a0b0c0d0e0f10111213141516171819"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 5 HMAC-SHA-224",
+     "546573742057697468205472756e636174696f6e",
+     "0e2aea68a90c8d37c988bcdb9fca6fa8",
+     "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 6 HMAC-SHA-224",
+     "54657374205573696e67204c6172676572205468616e20426c6f636b2d53697a65204b6579202d2048617368204b"
+     "6579204669727374",
+     "95e9a0db962095adaebe9b2d6f0dbce2d499f112f2d2b7273fa6870e",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha224,
+     "RFC 4231 Test Case 7 HMAC-SHA-224",
+     "5468697320697320612074657374207573696e672061206c6172676572207468616e20626c6f636b2d73697a6520"
+     "6b657920616e642061206c6172676572207468616e20626c6f636b2d73697a6520646174612e20546865206b6579"
+     "206e6565647320746f20626520686173686564206265666f7265206265696e672075736564206279207468652048"
+     "4d414320616c676f726974686d2e",
+     "3a854166ac5d9f023f54d517d0b39dbd946770db9c2b95c9f6f565d1",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+#endif
+#ifdef WITH_SHA256
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 1 HMAC-SHA-256",
+     "4869205468657265",
+     "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7",
+     "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 2 HMAC-SHA-256",
+     "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+     "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+     "4a656665"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 3 HMAC-SHA-256",
+     "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+     "dddddddd",
+     "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 4 HMAC-SHA-256",
+     "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+     "cdcdcdcd",
+     "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b",
+     "0102030405060708090a0b0c0d0e0f10111213141516171819"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 5 HMAC-SHA-256",
+     "546573742057697468205472756e636174696f6e",
+     "a3b6167473100ee06e0c796c2955552b",
+     "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 6 HMAC-SHA-256",
+     "54657374205573696e67204c6172676572205468616e20426c6f636b2d53697a65204b6579202d2048617368204b"
+     "6579204669727374",
+     "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha256,
+     "RFC 4231 Test Case 7 HMAC-SHA-256",
+     "5468697320697320612074657374207573696e672061206c6172676572207468616e20626c6f636b2d73697a6520"
+     "6b657920616e642061206c6172676572207468616e20626c6f636b2d73697a6520646174612e20546865206b6579"
+     "206e6565647320746f20626520686173686564206265666f7265206265696e672075736564206279207468652048"
+     "4d414320616c676f726974686d2e",
+     "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+#endif
+#ifdef WITH_SHA384
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 1 HMAC-SHA-384",
+     "4869205468657265",
+     "afd03944d84895626b0825f4ab46907f15f9dadbe4101ec682aa034c7cebc59cfaea9ea9076ede7f4af152e8b2fa"
+     "9cb6",
+     "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 2 HMAC-SHA-384",
+     "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+     "af45d2e376484031617f78d2b58a6b1b9c7ef464f5a01b47e42ec3736322445e8e2240ca5e69e2c78b3239ecfab2"
+     "1649",
+     "4a656665"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 3 HMAC-SHA-384",
+     "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+     "dddddddd",
+     "88062608d3e6ad8a0aa2ace014c8a86f0aa635d947ac9febe83ef4e55966144b2a5ab39dc13814b94e3ab6e101a3"
+     "4f27",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 4 HMAC-SHA-384",
+     "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+     "cdcdcdcd",
+     "3e8a69b7783c25851933ab6290af6ca77a9981480850009cc5577c6e1f573b4e6801dd23c4a7d679ccf8a386c674"
+     "cffb",
+     "0102030405060708090a0b0c0d0e0f10111213141516171819"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 5 HMAC-SHA-384",
+     "546573742057697468205472756e636174696f6e",
+     "3abf34c3503b2a23a46efc619baef897",
+     "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 6 HMAC-SHA-384",
+     "54657374205573696e67204c6172676572205468616e20426c6f636b2d53697a65204b6579202d2048617368204b"
+     "6579204669727374",
+     "4ece084485813e9088d2c63a041bc5b44f9ef1012a2b588f3cd11f05033ac4c60c2ef6ab4030fe8296248df163f4"
+     "4952",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha384,
+     "RFC 4231 Test Case 7 HMAC-SHA-384",
+     "5468697320697320612074657374207573696e672061206c6172676572207468616e20626c6f636b2d73697a6520"
+     "6b657920616e642061206c6172676572207468616e20626c6f636b2d73697a6520646174612e20546865206b6579"
+     "206e6565647320746f20626520686173686564206265666f7265206265696e672075736564206279207468652048"
+     "4d414320616c676f726974686d2e",
+     "6617178e941f020d351e2f254e8fd32c602420feb0b8fb9adccebb82461e99c5a678cc31e799176d3860e6110c46"
+     "523e",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+#endif
+#ifdef WITH_SHA512
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 1 HMAC-SHA-512",
+     "4869205468657265",
+     "87aa7cdea5ef619d4ff0b4241a1d6cb02379f4e2ce4ec2787ad0b30545e17cdedaa833b7d6b8a702038b274eaea3"
+     "f4e4be9d914eeb61f1702e696c203a126854",
+     "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 2 HMAC-SHA-512",
+     "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+     "164b7a7bfcf819e2e395fbe73b56e0a387bd64222e831fd610270cd7ea2505549758bf75c05a994a6d034f65f8f0"
+     "e6fdcaeab1a34d4a6b4b636e070a38bce737",
+     "4a656665"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 3 HMAC-SHA-512",
+     "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd"
+     "dddddddd",
+     "fa73b0089d56a284efb0f0756c890be9b1b5dbdd8ee81a3655f83e33b2279d39bf3e848279a722c806b485a47e67"
+     "c807b946a337bee8942674278859e13292fb",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 4 HMAC-SHA-512",
+     "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd"
+     "cdcdcdcd",
+     "b0ba465637458c6990e5a8c5f61d4af7e576d97ff94b872de76f8050361ee3dba91ca5c11aa25eb4d679275cc578"
+     "8063a5f19741120c4f2de2adebeb10a298dd",
+     "0102030405060708090a0b0c0d0e0f10111213141516171819"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 5 HMAC-SHA-512",
+     "546573742057697468205472756e636174696f6e",
+     "415fad6271580a531d4179bc891d87a6",
+     "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 6 HMAC-SHA-512",
+     "54657374205573696e67204c6172676572205468616e20426c6f636b2d53697a65204b6579202d2048617368204b"
+     "6579204669727374",
+     "80b24263c7c1a3ebb71493c1dd7be8b49b46d1f41b4aeec1121b013783f8f3526b56d037e05f2598bd0fd2215d6a"
+     "1e5295e64f73f63f0aec8b915a985d786598",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+    {Sha2Cpp::HashType::Sha512,
+     "RFC 4231 Test Case 7 HMAC-SHA-512",
+     "5468697320697320612074657374207573696e672061206c6172676572207468616e20626c6f636b2d73697a6520"
+     "6b657920616e642061206c6172676572207468616e20626c6f636b2d73697a6520646174612e20546865206b6579"
+     "206e6565647320746f20626520686173686564206265666f7265206265696e672075736564206279207468652048"
+     "4d414320616c676f726974686d2e",
+     "e37b6a775dc87dbaa4dfa9f96e5e3ffddebd71f8867289865df5a32d20cdc944b6022cac3c4982b10d5eeb55c3e4"
+     "de15134676fb6de0446065c97440fa8c6a58",
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+     "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+#endif
+};
+
+struct KdfTestCase
+{
+    Sha2Cpp::HashType type;
+    std::string name;
+    std::string password;
+    std::string salt;
+    uint32_t iterations;
+    std::string sample;
+};
+
+std::vector<KdfTestCase> testCases_PBKDF2 = {
+#ifdef WITH_SHA256
+    {Sha2Cpp::HashType::Sha256, "PBKDF2-Sha256 1 iteration", "password", "salt", 1,
+     "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"},
+    {Sha2Cpp::HashType::Sha256, "PBKDF2-Sha256 2 iterations", "password", "salt", 2,
+     "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"},
+    {Sha2Cpp::HashType::Sha256, "PBKDF2-Sha256 4096 iterations", "password", "salt", 4096,
+     "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"},
+    {Sha2Cpp::HashType::Sha256, "PBKDF2-Sha256 partial second block", "passwordPASSWORDpassword",
+     "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+     "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1c635518c7dac47e9"},
+    {Sha2Cpp::HashType::Sha256, "PBKDF2-Sha256 RFC 7914", "passwd", "salt", 1,
+     "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc49ca9cccf179b645991664b39d77ef317c71b845b1e30b"
+     "d509112041d3a19783"},
+#endif
+#ifdef WITH_SHA224
+    {Sha2Cpp::HashType::Sha224, "PBKDF2-Sha224 2 iterations", "password", "salt", 2,
+     "93200ffa96c5776d38fa10abdf8f5bfc0054b9718513df472d2331d2"},
+#endif
+#ifdef WITH_SHA512
+    {Sha2Cpp::HashType::Sha512, "PBKDF2-Sha512 1 iteration", "password", "salt", 1,
+     "867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252c02d470a285a0501bad999bfe943c08f050235d7d68b1da5"
+     "5e63f73b60a57fce"},
+    {Sha2Cpp::HashType::Sha512, "PBKDF2-Sha512 three blocks", "passwordPASSWORDpassword",
+     "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+     "8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71115b59f9e60cd9532fa33e0f75aefe30225c583a186cd8"
+     "2bd4daea9724a3d3b804f75bdd41494fa324cab24bcc680fb3b96a30cf5d21fac3c2875913919f3399b1d9ce7eb54c95ba49118596cf74"
+     "65719bbe02c4ecab1b1541298c321d13c6f6d414c28163b051a1d313cec13a76ebdbba624eb2c742"},
+    {Sha2Cpp::HashType::Sha512, "PBKDF2-Sha512 long password", std::string(200, 'x'), "salt", 3,
+     "7e06f7557aae6057f38260ec33f67b9675bebccb"},
+#endif
+#ifdef WITH_SHA384
+    {Sha2Cpp::HashType::Sha384, "PBKDF2-Sha384 2 iterations", "password", "salt", 2,
+     "54f775c6d790f21930459162fc535dbf04a939185127016a04176a0730c6f1f4fb48832ad1261baadd2cedd50814b1c8"},
+#endif
+};
+
+struct HkdfTestCase
+{
+    Sha2Cpp::HashType type;
+    std::string name;
+    std::string salt;
+    std::string ikm;
+    std::string info;
+    std::string prk;
+    std::string okm;
+};
+
+// salt, ikm and info are hex encoded
+std::vector<HkdfTestCase> testCases_HKDF = {
+#ifdef WITH_SHA256
+    {Sha2Cpp::HashType::Sha256, "HKDF-Sha256 RFC 5869 test case 1", "000102030405060708090a0b0c",
+     "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b", "f0f1f2f3f4f5f6f7f8f9",
+     "077709362c2e32df0ddc3f0dc47bba6390b6c73bb50f9c3122ec844ad7c2b3e5",
+     "3cb25f25faacd57a90434f64d0362f2a2d2d0a90cf1a5a4c5db02d56ecc4c5bf34007208d5b887185865"},
+    {Sha2Cpp::HashType::Sha256, "HKDF-Sha256 RFC 5869 test case 2",
+     "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f808182838485868788898a8b8c8d8e8f909192939495969798"
+     "999a9b9c9d9e9fa0a1a2a3a4a5a6a7a8a9aaabacadaeaf",
+     "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728292a2b2c2d2e2f3031323334353637"
+     "38393a3b3c3d3e3f404142434445464748494a4b4c4d4e4f",
+     "b0b1b2b3b4b5b6b7b8b9babbbcbdbebfc0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8"
+     "e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff",
+     "06a6b88c5853361a06104c9ceb35b45cef760014904671014a193f40c15fc244",
+     "b11e398dc80327a1c8e7f78c596a49344f012eda2d4efad8a050cc4c19afa97c59045a99cac7827271cb41c65e590e09da3275600c2f09b836"
+     "7793a9aca3db71cc30c58179ec3e87c14c01d5c1f3434f1d87"},
+    {Sha2Cpp::HashType::Sha256, "HKDF-Sha256 RFC 5869 test case 3", "", "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+     "", "19ef24a32c717b167f33a91d6f648bdf96596776afdb6377ac434c1c293ccb04",
+     "8da4e775a563c18f715f802a063c5a31b8a11f5c5ee1879ec3454e5f3c738d2d9d201395faa4b61a96c8"},
+#endif
+#ifdef WITH_SHA224
+    {Sha2Cpp::HashType::Sha224, "HKDF-Sha224 partial last block", "73616c74", "696b6d", "696e666f",
+     "daeb56ea69946c3b0754170b71ded044a9c46a76dd64c5f1275cc52d",
+     "907c85ca7147a0c8791edd4e386039ef23c71a3f34ec4419af8ecde25e4ab3bc821eb07c9cd7a2e7bc8fe7a755f24a452832588141e0dfc3"
+     "5b89d4032306f226e25d1b939c47559b61395b56902abd6e8a30a2768f478ee7bfc90303091ef85624ed4edc"},
+#endif
+#ifdef WITH_SHA512
+    {Sha2Cpp::HashType::Sha512, "HKDF-Sha512 four blocks", "73616c74", "696e707574206b6579206d6174657269616c",
+     "636f6e74657874",
+     "eb21b2c6b482ecc6346d064dc40ee40f96e8ef106d511617ab01ef74154438823d40e47ab56d99cedfc803b14d398541fdf15a103fbb7270"
+     "7cc449a1c88b1cdb",
+     "0d91dde5b192629286a8a248069d686f5f88514fa6f0489c148f614dfae9830924b874f1d1c5de322428235486e7f47e2f4cc7686414313"
+     "87d2fe6a86682f9389ec9ce8dab0c448810cc7a1b43d86d27d323890a18686442d02cfed30b6b35f88018744c15f340128f9f1e1fe9eaadd"
+     "35ab0a4ebe4ee6a1ee3e56f5dd58bfaa2760adeb552ff2a3bec2c02f4d480cbe718fca530a8bcc8de48be9bf8200b150e15df16a0222f3ad"
+     "b7c0276a622b787609b46c1d3586a8cc7d616a7884dce6accfea781d421164890"},
+#endif
+#ifdef WITH_SHA384
+    {Sha2Cpp::HashType::Sha384, "HKDF-Sha384 empty salt and info", "", "696e707574206b6579206d6174657269616c", "",
+     "96a2b16914376241df5d2f6162dbdbd0300282927c54a2a172750da558e9fe74deca502fe9131c505a7d58255df11837",
+     "f600680e677bb417a7a22a4da8b167c0d91823a7a5d56a49aeb1838bb2320c05068d15d6d980824fee542a279d310c3a"},
+#endif
+#ifdef WITH_SHA512_256
+    {Sha2Cpp::HashType::Sha512_256, "HKDF-Sha512/256 partial last block", "73616c74", "696b6d", "696e666f",
+     "ae3ba992da4d8905266f1148b9e31b550da5afd10c0bda895f905de374aafdd3",
+     "234e926bcc6f74eb213f29db8f2d16f99c05e09dd83e20a66b6cf4d7e3450e76511b81d73388eb3cb473f2a1bf40edf13d8476f2caec4e4e3"
+     "15411cc07af7ec890290306199e"},
+#endif
+};
+
+struct EncodingTestCase
+{
+    std::string data;
+    std::string hex;
+    std::string base64;
+    std::string base64url;
+};
+
+// RFC 4648 section 10 plus bytes that use the last two symbols of each alphabet
+std::vector<EncodingTestCase> testCases_Encoding = {
+    {"", "", "", ""},
+    {"f", "66", "Zg==", "Zg"},
+    {"fo", "666f", "Zm8=", "Zm8"},
+    {"foo", "666f6f", "Zm9v", "Zm9v"},
+    {"foob", "666f6f62", "Zm9vYg==", "Zm9vYg"},
+    {"fooba", "666f6f6261", "Zm9vYmE=", "Zm9vYmE"},
+    {"foobar", "666f6f626172", "Zm9vYmFy", "Zm9vYmFy"},
+    {"\xfb\xff\xbf\x69\xb7\x1d", "fbffbf69b71d", "+/+/abcd", "-_-_abcd"},
+    {"The quick brown fox jumps over the lazy dog",
+     "54686520717569636b2062726f776e20666f78206a756d7073206f76657220746865206c617a7920646f67",
+     "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZw==",
+     "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZw"},
+};
+
 #if defined __linux__ || __APPLE__
 
 #define FgBlack "\e[1;30m"
@@ -400,21 +1294,10 @@ std::vector<TestCase> testCases_HMAC = {
 #define Clear ""
 #endif
 
-static std::string byte2hex(uint8_t byte)
-{
-    static char hex[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-    return std::string(1, hex[byte >> 4]) + hex[byte & 0x0F];
-}
-
-static std::string array2string(const std::vector<uint8_t> &arr)
+static std::string hex2string(const std::string &hex)
 {
-    std::string str;
-    for (const uint8_t &ch : arr)
-    {
-        str += byte2hex(ch);
-    }
-
-    return str;
+    std::vector<uint8_t> bytes = Sha2Cpp::FromHex(hex);
+    return std::string(bytes.begin(), bytes.end());
 }
 
 int main()
@@ -426,28 +1309,1139 @@ int main()
     for (auto const &test : testCases)
     {
         std::vector<uint8_t> hash = testInstances.Hash(test.type, test.str);
+        std::vector<uint8_t> hash_into = testInstances.HashInto(test.type, test.str);
         std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
         std::cout << "original string: " << FgCyan << test.str << Clear << std::endl;
         std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
-        std::cout << "calculated hash: " << FgMagenta << array2string(hash) << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
 
-        bool is_pass = (array2string(hash).compare(test.sample) == 0);
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0) && (hash_into == hash);
         std::cout << "result: "
                   << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
                   << std::endl;
         std::cout << std::endl;
     }
 
-    std::cout << BgWhite << FgBlack << "---------------- HMAC tests ----------------" << Clear << "\n" << std::endl;
-    for (auto const &test : testCases_HMAC)
+    std::cout << BgWhite << FgBlack << "---------------- Portable backend tests ----------------" << Clear << "\n"
+              << std::endl;
+    Sha2Cpp::CpuFeatures detected = Sha2Cpp::CpuFeatures::Get();
+    Sha2Cpp::CpuFeatures::Override(Sha2Cpp::CpuFeatures());
+    for (auto const &test : testCases)
     {
-        std::vector<uint8_t> hash = testInstances.HMAC(test.type, test.str, test.key);
-        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
-        std::cout << "original string: " << FgCyan << test.str << Clear << std::endl;
-        std::cout << "key string: " << FgCyan << test.key << Clear << std::endl;
+        std::vector<uint8_t> hash = testInstances.Hash(test.type, test.str);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " without CPU extensions" << Clear
+                  << std::endl;
         std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
-        std::cout << "calculated hash: " << FgMagenta << array2string(hash) << Clear << std::endl;
-        bool is_pass = (array2string(hash).compare(test.sample) == 0);
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+    Sha2Cpp::CpuFeatures::Override(detected);
+
+    {
+        // the override can only turn extensions off, never on for a CPU that lacks them
+        Sha2Cpp::CpuFeatures all;
+        all.x86Sha = all.avx2 = all.avx512 = all.armSha2 = all.armSha512 = true;
+        Sha2Cpp::CpuFeatures::Override(all);
+        const Sha2Cpp::CpuFeatures &active = Sha2Cpp::CpuFeatures::Get();
+        bool is_pass = active.x86Sha == detected.x86Sha && active.avx2 == detected.avx2
+                       && active.avx512 == detected.avx512 && active.armSha2 == detected.armSha2
+                       && active.armSha512 == detected.armSha512;
+        Sha2Cpp::CpuFeatures::Override(detected);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "CPU feature override limited to detected extensions"
+                  << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    std::cout << BgWhite << FgBlack << "---------------- Batch tests ----------------" << Clear << "\n" << std::endl;
+    std::vector<Sha2Cpp::CpuFeatures> backends(4, detected);
+    backends[1].avx512 = false;
+    backends[2].x86Sha = false;
+    backends[3].x86Sha = backends[3].avx512 = false;
+    for (auto const &backend : backends)
+    {
+        Sha2Cpp::CpuFeatures::Override(backend);
+        for (auto const &first : testCases)
+        {
+            // one batch per hash type, repeated so that it spans more messages than SIMD lanes
+            std::vector<const TestCase *> batchCases;
+            std::vector<std::string> batch;
+            for (size_t n = 0; n < 7; n++)
+            {
+                for (auto const &test : testCases)
+                {
+                    if (test.type == first.type)
+                    {
+                        batchCases.push_back(&test);
+                        batch.push_back(test.str);
+                    }
+                }
+            }
+            if (batchCases.front() != &first)
+            {
+                continue;
+            }
+
+            std::vector<std::vector<uint8_t>> hashes = testInstances.HashMany(first.type, batch);
+            size_t mismatches = 0;
+            for (size_t n = 0; n < batch.size(); n++)
+            {
+                mismatches += (Sha2Cpp::ToHex(hashes[n]).compare(batchCases[n]->sample) == 0) ? 0 : 1;
+            }
+
+            std::cout << (++i) << ". Executing test:  " << FgBlue << first.name << " batch of " << batch.size()
+                      << " messages" << Clear << std::endl;
+            bool is_pass = (mismatches == 0);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+    Sha2Cpp::CpuFeatures::Override(detected);
+
+    std::cout << BgWhite << FgBlack << "---------------- Streaming tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases)
+    {
+        for (size_t chunk : {1, 7, 64, 127, 1000})
+        {
+            std::vector<uint8_t> hash = testInstances.HashStreaming(test.type, test.str, chunk);
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " in chunks of " << chunk << Clear
+                      << std::endl;
+            std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+
+            bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+
+    std::cout << BgWhite << FgBlack << "---------------- Fixed length tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto type : {Sha2Cpp::HashType::Sha256, Sha2Cpp::HashType::Sha224, Sha2Cpp::HashType::Sha512,
+                      Sha2Cpp::HashType::Sha384, Sha2Cpp::HashType::Sha512_256, Sha2Cpp::HashType::Sha512_224})
+    {
+        if (!Sha2Cpp::Hasher::Supported(type))
+        {
+            continue;
+        }
+        bool is_pass = testInstances.FixedLengthMismatches(type) == 0;
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "HashFixed and DoubleHash of hash type "
+                  << static_cast<int>(type) << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+#ifdef WITH_SHA256
+    {
+        std::string expected = "9595c9df90075148eb06860365df33584b75bff782a510c6cd4883a419833d50";
+        std::string doubled = Sha2Cpp::ToHex(Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256>::DoubleHash("hello"));
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "SHA-256d of \"hello\"" << Clear << std::endl;
+        std::cout << "expected hash:   " << FgYellow << expected << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << doubled << Clear << std::endl;
+        bool is_pass = (doubled == expected);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- Runtime hasher tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto const &test : testCases)
+    {
+        Sha2Cpp::Hasher hasher(test.type);
+        std::vector<uint8_t> hash = hasher.Hash(test.str);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " selected at runtime" << Clear
+                  << std::endl;
+        std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0) && hasher.Type() == test.type
+                       && hasher.DigestSize() * 2 == test.sample.size() && Sha2Cpp::Hasher::Supported(test.type);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        for (size_t chunk : {1, 64, 1000})
+        {
+            for (size_t split : {size_t(0), test.str.size() / 2, test.str.size()})
+            {
+                std::string streamed = Sha2Cpp::ToHex(hasherStreaming(test.type, test.str, chunk));
+                std::string resumed = Sha2Cpp::ToHex(hasherResumed(test.type, test.str, split));
+                std::cout << (++i) << ". Executing test:  " << FgBlue << test.name
+                          << " selected at runtime in chunks of " << chunk << ", resumed at " << split << Clear
+                          << std::endl;
+                std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+                std::cout << "calculated hash: " << FgMagenta << streamed << " / " << resumed << Clear << std::endl;
+                is_pass = (streamed.compare(test.sample) == 0) && (resumed.compare(test.sample) == 0);
+                std::cout << "result: "
+                          << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                          << Clear << std::endl;
+                std::cout << std::endl;
+            }
+        }
+    }
+
+#ifdef WITH_SHA256
+    std::cout << BgWhite << FgBlack << "---------------- Input view tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases)
+    {
+        if (test.type != Sha2Cpp::HashType::Sha256)
+        {
+            continue;
+        }
+
+        std::vector<std::vector<uint8_t>> hashes = {
+            testInstances.hash256.Hash(test.str.data(), test.str.size()),
+            testInstances.hash256.Hash(std::vector<uint8_t>(test.str.begin(), test.str.end())),
+            testInstances.hash256.Hash(test.str.c_str()),
+#if __cplusplus >= 201703L
+            testInstances.hash256.Hash(std::string_view(test.str)),
+#endif
+        };
+        for (auto const &hash : hashes)
+        {
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " through a view" << Clear << std::endl;
+            std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+
+            bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+#endif
+
+#ifdef WITH_SHA256
+    std::cout << BgWhite << FgBlack << "---------------- File tests ----------------" << Clear << "\n" << std::endl;
+    const std::string fileName = "sha2cpp_test_file.tmp";
+    for (auto const &test : testCases)
+    {
+        if (test.type != Sha2Cpp::HashType::Sha256)
+        {
+            continue;
+        }
+
+        std::ofstream(fileName, std::ios::binary) << test.str;
+        std::vector<uint8_t> hash = Sha2Cpp::HashFile<Sha2Cpp::HashType::Sha256>(fileName);
+        std::vector<uint8_t> mapped = Sha2Cpp::HashFile<Sha2Cpp::HashType::Sha256>(fileName, Sha2Cpp::FileAccess::Map);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " from a file" << Clear << std::endl;
+        std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0) && mapped == hash;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+    std::remove(fileName.c_str());
+
+    {
+        std::vector<uint8_t> hash = Sha2Cpp::HashFile<Sha2Cpp::HashType::Sha256>(fileName);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Sha256 missing file" << Clear << std::endl;
+        bool is_pass = hash.empty();
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+#ifdef SHA2CPP_POSIX
+    {
+        // a consumer that throws must not leak the descriptor, the lowest free one is handed out again
+        std::ofstream(fileName, std::ios::binary) << "some content";
+        int probe = open(fileName.c_str(), O_RDONLY);
+        close(probe);
+        bool is_pass = false;
+        try
+        {
+            Sha2Cpp::ReadFile(fileName, [](const uint8_t *, size_t) { throw std::runtime_error("consumer failed"); });
+        }
+        catch (const std::runtime_error &)
+        {
+            is_pass = true;
+        }
+        int reopened = open(fileName.c_str(), O_RDONLY);
+        is_pass = is_pass && reopened == probe;
+        close(reopened);
+        std::remove(fileName.c_str());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "File closed when the consumer throws" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    {
+        // a file truncated while it is read ends the read early instead of faulting
+        std::ofstream(fileName, std::ios::binary) << std::string(3 << 20, 'x');
+        size_t received = 0;
+        bool read = Sha2Cpp::ReadFile(fileName, [&received, &fileName](const uint8_t *, size_t length) {
+            received += length;
+            if (truncate(fileName.c_str(), 0) != 0)
+            {
+                received = 0;
+            }
+        });
+        bool is_pass = read && received > 0 && received < (3 << 20);
+        std::remove(fileName.c_str());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "File truncated while it is read" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+#endif
+
+
+#if defined(WITH_SHA256) && defined(SHA2CPP_POSIX)
+    std::cout << BgWhite << FgBlack << "---------------- Deduplication tests ----------------" << Clear << "\n"
+              << std::endl;
+    {
+        std::string data(1 << 20, '\0');
+        uint64_t seed = 88172645463325252ull;
+        for (auto &c : data)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            c = static_cast<char>(seed);
+        }
+
+        // the same boundaries whether the data arrives at once or in small pieces
+        Sha2Cpp::Chunker whole(1024);
+        Sha2Cpp::Chunker pieces(1024);
+        std::vector<size_t> wholeSizes;
+        std::vector<size_t> pieceSizes;
+        bool boundary;
+        for (size_t pos = 0; pos < data.size();)
+        {
+            size_t count = whole.Next(reinterpret_cast<const uint8_t *>(data.data()) + pos, data.size() - pos, boundary);
+            pos += count;
+            wholeSizes.push_back(count);
+        }
+        size_t length = 0;
+        for (size_t pos = 0; pos < data.size(); pos += 1000)
+        {
+            size_t piece = std::min<size_t>(1000, data.size() - pos);
+            for (size_t used = 0; used < piece;)
+            {
+                size_t count = pieces.Next(reinterpret_cast<const uint8_t *>(data.data()) + pos + used, piece - used, boundary);
+                used += count;
+                length += count;
+                if (boundary)
+                {
+                    pieceSizes.push_back(length);
+                    length = 0;
+                }
+            }
+        }
+        pieceSizes.push_back(length);
+        bool is_pass = wholeSizes == pieceSizes;
+        for (size_t n = 0; n + 1 < wholeSizes.size(); n++)
+        {
+            is_pass = is_pass && wholeSizes[n] >= whole.MinSize() && wholeSizes[n] <= whole.MaxSize();
+        }
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Content defined chunks of 1 MB, " << wholeSizes.size()
+                  << " chunks" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        const std::string indexName = "sha2cpp_test_index.tmp";
+        std::remove(indexName.c_str());
+        Sha2Cpp::ThreadPool dedupPool(3);
+        Sha2Cpp::DedupIndex index;
+        is_pass = index.Open(indexName, Sha2Cpp::HashType::Sha256);
+        Sha2Cpp::Deduplicator dedup(index, 256, dedupPool);
+
+        // every chunk is reported in order with its digest, the index stores the offsets
+        Sha2Cpp::Deduplicator::Stats first;
+        uint64_t expectedOffset = 0;
+        std::vector<std::vector<uint8_t>> digests;
+        is_pass = is_pass && dedup.Add(data, [&](const Sha2Cpp::DedupChunk &chunk) {
+            Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hasher;
+            is_pass = is_pass && chunk.offset == expectedOffset && !chunk.known
+                      && hasher.Hash(chunk.data) == std::vector<uint8_t>(chunk.digest, chunk.digest + 32);
+            expectedOffset += chunk.data.size();
+            digests.emplace_back(chunk.digest, chunk.digest + 32);
+            return chunk.offset;
+        }, first);
+        is_pass = is_pass && expectedOffset == data.size() && first.chunks == first.newChunks && first.bytes == data.size()
+                  && index.Size() == first.chunks;
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Deduplication of 1 MB into " << first.chunks
+                  << " new chunks" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // the same data again from a file, nothing is new and the stored values come back
+        std::ofstream(fileName, std::ios::binary) << data;
+        Sha2Cpp::Deduplicator::Stats repeated;
+        expectedOffset = 0;
+        is_pass = dedup.AddFile(fileName, [&](const Sha2Cpp::DedupChunk &chunk) {
+            is_pass = is_pass && chunk.known && chunk.value == chunk.offset;
+            return 0;
+        }, repeated);
+        std::remove(fileName.c_str());
+        is_pass = is_pass && repeated.chunks == first.chunks && repeated.newChunks == 0;
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Deduplication of the same data from a file" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // an insertion changes only the chunks around it
+        std::string shifted = data.substr(0, 500000) + "inserted" + data.substr(500000);
+        Sha2Cpp::Deduplicator::Stats shift;
+        is_pass = dedup.Add(shifted, nullptr, shift) && shift.newBytes < shifted.size() / 50;
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Deduplication after an insertion, " << shift.newBytes
+                  << " new bytes" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // the index survives reopening, a foreign hash type is refused. While it is open, also
+        // after it has grown into a new file, a second handle cannot take it
+        uint64_t size = index.Size();
+        Sha2Cpp::DedupIndex second;
+        bool exclusive = !second.Open(indexName, Sha2Cpp::HashType::Sha256);
+        index.Close();
+        Sha2Cpp::DedupIndex reopened;
+        is_pass = exclusive && reopened.Open(indexName, Sha2Cpp::HashType::Sha256) && reopened.Size() == size;
+        for (auto const &digest : digests)
+        {
+            uint64_t value = 0;
+            is_pass = is_pass && reopened.Find(digest.data(), value);
+        }
+        reopened.Close();
+#ifdef WITH_SHA512
+        is_pass = is_pass && !reopened.Open(indexName, Sha2Cpp::HashType::Sha512);
+#endif
+        std::remove(indexName.c_str());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Reopened deduplication index of " << size
+                  << " digests" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // a corrupted index with every slot marked used fails lookups and inserts instead of
+        // probing forever, a header whose capacity does not match the file size is refused
+        Sha2Cpp::DedupIndex corrupted;
+        is_pass = corrupted.Open(indexName, Sha2Cpp::HashType::Sha256);
+        corrupted.Close();
+        {
+            std::fstream file(indexName, std::ios::binary | std::ios::in | std::ios::out);
+            for (size_t slot = 0; slot < 1024; slot++)
+            {
+                file.seekp(32 + slot * (1 + 32 + 8));
+                file.put(1);
+            }
+        }
+        uint64_t value = 0;
+        is_pass = is_pass && corrupted.Open(indexName, Sha2Cpp::HashType::Sha256)
+                  && !corrupted.Find(digests.front().data(), value) && !corrupted.Insert(digests.front().data(), 1);
+        corrupted.Close();
+        {
+            std::fstream file(indexName, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(16 + 7);
+            file.put(0x10);
+        }
+        is_pass = is_pass && !corrupted.Open(indexName, Sha2Cpp::HashType::Sha256);
+        std::remove(indexName.c_str());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Corrupted deduplication index" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+#if defined(WITH_SHA256) && defined(SHA2CPP_POSIX)
+    std::cout << BgWhite << FgBlack << "---------------- Digest cache tests ----------------" << Clear << "\n"
+              << std::endl;
+    {
+        typedef Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> Sha256;
+        const std::string cacheName = "sha2cpp_test_cache.tmp";
+        // files modified in the last seconds are not cached, date the test file back
+        const struct timeval past[2] = {{1000000000, 0}, {1000000000, 0}};
+        std::remove(cacheName.c_str());
+        std::ofstream(fileName, std::ios::binary) << "cached content";
+        utimes(fileName.c_str(), past);
+
+        Sha2Cpp::DigestCache cache;
+        Sha2Cpp::DigestCache other;
+        bool is_pass = cache.Open(cacheName) && other.Open(cacheName);
+        std::vector<uint8_t> cold = Sha2Cpp::HashFile<Sha2Cpp::HashType::Sha256>(cache, fileName);
+        uint8_t digest[Sha256::DigestSize];
+        is_pass = is_pass && cold == Sha256().Hash("cached content") && cache.Size() == 1
+                  && cache.Lookup(fileName, Sha2Cpp::HashType::Sha256, digest) && cold == std::vector<uint8_t>(digest, digest + 32)
+                  && other.Lookup(fileName, Sha2Cpp::HashType::Sha256, digest)
+                  && !other.Lookup(fileName, Sha2Cpp::HashType::Sha224, digest);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Digest cache shared by two handles" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // same inode, size and mtime, only the status change time tells the content changed.
+        // Wait out the file system's timestamp granularity so that the ctime does move
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::ofstream(fileName, std::ios::binary) << "cached c0ntent";
+        utimes(fileName.c_str(), past);
+        std::vector<uint8_t> changed = Sha2Cpp::HashFile<Sha2Cpp::HashType::Sha256>(other, fileName);
+        is_pass = changed == Sha256().Hash("cached c0ntent");
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Digest cache entry of a changed file" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // enough appends to compact the log, both handles follow the new file
+        Sha2Cpp::FileIdentity identity;
+        is_pass = Sha2Cpp::FileIdentity::Get(fileName, identity);
+        for (size_t n = 0; n < 5000; n++)
+        {
+            is_pass = is_pass && cache.Store(fileName, Sha2Cpp::HashType::Sha256, identity, changed.data());
+        }
+        std::ifstream log(cacheName, std::ios::binary | std::ios::ate);
+        is_pass = is_pass && static_cast<size_t>(log.tellg()) < 2048 * 128 && cache.Size() == 1
+                  && other.Lookup(fileName, Sha2Cpp::HashType::Sha256, digest)
+                  && changed == std::vector<uint8_t>(digest, digest + 32);
+        cache.Close();
+        is_pass = is_pass && cache.Open(cacheName) && cache.Lookup(fileName, Sha2Cpp::HashType::Sha256, digest);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Digest cache compaction" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // threads with a handle each store concurrently. Every path is stored exactly once, in
+        // between a hot path is stored over and over to pass the compaction threshold several
+        // times, so a record lost while the log is rewritten under the other writers shows up
+        const size_t writers = 4;
+        const size_t paths = 500;
+        std::vector<std::future<bool>> stores;
+        for (size_t writer = 0; writer < writers; writer++)
+        {
+            stores.push_back(std::async(std::launch::async, [&cacheName, writer, paths]() {
+                Sha2Cpp::DigestCache handle;
+                bool ok = handle.Open(cacheName);
+                std::string prefix = "writer" + std::to_string(writer) + "/";
+                uint8_t entryDigest[Sha256::DigestSize] = {static_cast<uint8_t>(writer)};
+                for (size_t n = 0; n < paths * 12; n++)
+                {
+                    Sha2Cpp::FileIdentity entryIdentity = {1, n / 12, 3, 4, 5};
+                    entryDigest[1] = static_cast<uint8_t>(n / 12);
+                    entryDigest[2] = static_cast<uint8_t>(n / 12 >> 8);
+                    ok = ok
+                         && handle.Store(prefix + (n % 12 == 0 ? std::to_string(n / 12) : std::string("hot")),
+                                         Sha2Cpp::HashType::Sha256, entryIdentity, entryDigest);
+                }
+                return ok;
+            }));
+        }
+        is_pass = true;
+        for (auto &store : stores)
+        {
+            is_pass = store.get() && is_pass;
+        }
+        Sha2Cpp::DigestCache merged;
+        is_pass = is_pass && merged.Open(cacheName) && merged.Size() == 1 + writers * (paths + 1);
+        for (size_t writer = 0; writer < writers; writer++)
+        {
+            for (size_t n = 0; n < paths; n++)
+            {
+                Sha2Cpp::FileIdentity entryIdentity = {1, n, 3, 4, 5};
+                is_pass = is_pass
+                          && merged.Lookup("writer" + std::to_string(writer) + "/" + std::to_string(n),
+                                           Sha2Cpp::HashType::Sha256, entryIdentity, digest)
+                          && digest[0] == writer && digest[1] == (n & 0xff) && digest[2] == (n >> 8);
+            }
+        }
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Digest cache written by " << writers
+                  << " handles at once" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+
+        // a file that is not a cache is refused
+        Sha2Cpp::DigestCache foreign;
+        is_pass = !foreign.Open(fileName);
+        std::remove(fileName.c_str());
+        std::remove(cacheName.c_str());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Digest cache over a foreign file" << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- Batch hasher tests ----------------" << Clear << "\n"
+              << std::endl;
+    {
+        // one batch per hash type in flight at once, each with a buffer hashed in many slices
+        Sha2Cpp::ThreadPool pool(4);
+        Sha2Cpp::BatchHasher batchHasher(pool, 1 << 16);
+        std::string large(3 << 20, '\0');
+        for (size_t n = 0; n < large.size(); n++)
+        {
+            large[n] = static_cast<char>(n * 7 + n / 4096);
+        }
+
+        std::vector<Sha2Cpp::HashType> types;
+        for (auto const &test : testCases)
+        {
+            if (std::find(types.begin(), types.end(), test.type) == types.end())
+            {
+                types.push_back(test.type);
+            }
+        }
+
+        std::vector<std::future<Sha2Cpp::BatchHasher::Digests>> results;
+        for (auto type : types)
+        {
+            std::vector<Sha2Cpp::ByteView> buffers(1, large);
+            for (auto const &test : testCases)
+            {
+                if (test.type == type)
+                {
+                    buffers.push_back(test.str);
+                }
+            }
+            results.push_back(batchHasher.Submit(type, buffers));
+        }
+
+        for (size_t t = 0; t < types.size(); t++)
+        {
+            Sha2Cpp::BatchHasher::Digests digests = results[t].get();
+            size_t n = 1;
+            for (auto const &test : testCases)
+            {
+                if (test.type != types[t])
+                {
+                    continue;
+                }
+                std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " in a batch" << Clear
+                          << std::endl;
+                std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+                std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(digests[n]) << Clear << std::endl;
+                bool is_pass = (Sha2Cpp::ToHex(digests[n++]).compare(test.sample) == 0);
+                std::cout << "result: "
+                          << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                          << Clear << std::endl;
+                std::cout << std::endl;
+            }
+
+            std::cout << (++i) << ". Executing test:  " << FgBlue << "3 MB buffer sliced in a batch" << Clear
+                      << std::endl;
+            bool is_pass = digests[0] == testInstances.Hash(types[t], large);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+
+#ifdef WITH_SHA256
+        // files with a completion callback, the missing one gets an empty digest
+        std::vector<std::string> paths;
+        for (auto const &test : testCases)
+        {
+            if (test.type == Sha2Cpp::HashType::Sha256)
+            {
+                paths.push_back("sha2cpp_batch_" + std::to_string(paths.size()) + ".tmp");
+                std::ofstream(paths.back(), std::ios::binary) << test.str;
+            }
+        }
+        paths.push_back("sha2cpp_batch_missing.tmp");
+
+        std::promise<Sha2Cpp::BatchHasher::Digests> done;
+        batchHasher.SubmitFiles(Sha2Cpp::HashType::Sha256, paths,
+                                [&done](Sha2Cpp::BatchHasher::Digests digests) { done.set_value(std::move(digests)); });
+        Sha2Cpp::BatchHasher::Digests digests = done.get_future().get();
+        for (auto const &path : paths)
+        {
+            std::remove(path.c_str());
+        }
+
+        size_t n = 0;
+        bool is_pass = true;
+        for (auto const &test : testCases)
+        {
+            if (test.type == Sha2Cpp::HashType::Sha256)
+            {
+                is_pass = is_pass && Sha2Cpp::ToHex(digests[n++]).compare(test.sample) == 0;
+            }
+        }
+        is_pass = is_pass && digests[n].empty();
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Sha256 batch of files with a callback" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+#endif
+
+        // an empty batch completes on a worker, a hash type that is not compiled in is refused
+        std::promise<std::thread::id> emptyDone;
+        batchHasher.Submit(types.front(), std::vector<Sha2Cpp::ByteView>(),
+                           [&emptyDone](Sha2Cpp::BatchHasher::Digests) { emptyDone.set_value(std::this_thread::get_id()); });
+        bool emptyPass = emptyDone.get_future().get() != std::this_thread::get_id();
+        try
+        {
+            batchHasher.Submit(static_cast<Sha2Cpp::HashType>(99), std::vector<Sha2Cpp::ByteView>(1, large));
+            emptyPass = false;
+        }
+        catch (const std::invalid_argument &)
+        {
+        }
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Empty batch and unknown hash type" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (emptyPass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                  << Clear << std::endl;
+        std::cout << std::endl;
+
+        // a throwing callback reaches Wait() once, the batches after it still complete
+        batchHasher.Submit(types.front(), std::vector<Sha2Cpp::ByteView>(2, large),
+                           [](Sha2Cpp::BatchHasher::Digests) { throw std::runtime_error("callback failed"); });
+        std::future<Sha2Cpp::BatchHasher::Digests> after =
+            batchHasher.Submit(types.front(), std::vector<Sha2Cpp::ByteView>(1, large));
+        bool throwPass = false;
+        try
+        {
+            batchHasher.Wait();
+        }
+        catch (const std::runtime_error &)
+        {
+            throwPass = true;
+        }
+        batchHasher.Wait();
+        throwPass = throwPass && after.get().size() == 1;
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Batch completion callback that throws" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (throwPass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                  << Clear << std::endl;
+        std::cout << std::endl;
+    }
+
+#ifdef WITH_SHA256
+    std::cout << BgWhite << FgBlack << "---------------- Tree hash tests ----------------" << Clear << "\n" << std::endl;
+    Sha2Cpp::ThreadPool singleThread(1);
+    Sha2Cpp::ThreadPool fourThreads(4);
+    for (auto const &test : testCases)
+    {
+        if (test.type != Sha2Cpp::HashType::Sha256)
+        {
+            continue;
+        }
+
+        for (size_t chunk : {1, 7, 64, 1000})
+        {
+            std::string expected = Sha2Cpp::ToHex(treeReference(test.str, chunk));
+            std::string single = Sha2Cpp::ToHex(Sha2Cpp::TreeHash<Sha2Cpp::HashType::Sha256>(chunk, singleThread).Hash(test.str));
+            std::string parallel = Sha2Cpp::ToHex(Sha2Cpp::TreeHash<Sha2Cpp::HashType::Sha256>(chunk, fourThreads).Hash(test.str));
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " tree of " << chunk << " byte chunks"
+                      << Clear << std::endl;
+            std::cout << "expected hash:   " << FgYellow << expected << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << parallel << Clear << std::endl;
+
+            bool is_pass = (single == expected) && (parallel == expected);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+    std::cout << BgWhite << FgBlack << "---------------- Merkle tree tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (size_t count : {0, 1, 2, 3, 5, 8, 13, 100, 5000})
+    {
+        typedef Sha2Cpp::MerkleTree<Sha2Cpp::HashType::Sha256> Merkle;
+        std::vector<std::string> chunks;
+        std::vector<Sha2Cpp::ByteView> views;
+        std::vector<uint8_t> leaves;
+        for (size_t n = 0; n < count; n++)
+        {
+            chunks.push_back("chunk " + std::to_string(n));
+        }
+        for (size_t n = 0; n < count; n++)
+        {
+            views.push_back(chunks[n]);
+            Merkle::Digest leaf = Merkle::HashLeaf(chunks[n]);
+            leaves.insert(leaves.end(), leaf.begin(), leaf.end());
+        }
+
+        Merkle parallel(fourThreads);
+        parallel.BuildFromChunks(views.data(), views.size());
+        Merkle sequential(singleThread);
+        sequential.Build(leaves.data(), count);
+        std::string expected = Sha2Cpp::ToHex(merkleReference(chunks, 0, count));
+        bool is_pass = Sha2Cpp::ToHex(parallel.Root()) == expected && sequential.Root() == parallel.Root();
+
+        // every proof verifies, a proof for another position or a damaged one does not
+        for (size_t n = 0; n < count; n++)
+        {
+            std::vector<uint8_t> proof = parallel.Proof(n);
+            is_pass = is_pass && Merkle::VerifyProof(parallel.Root(), parallel.Node(0, n), n, count, proof);
+            is_pass = is_pass && !Merkle::VerifyProof(parallel.Root(), parallel.Node(0, n), n ^ 1, count, proof);
+            if (!proof.empty())
+            {
+                proof[n % proof.size()] ^= 1;
+                is_pass = is_pass && !Merkle::VerifyProof(parallel.Root(), parallel.Node(0, n), n, count, proof);
+            }
+        }
+
+        // a few changed leaves give the same root as a rebuild
+        std::vector<size_t> changed;
+        std::vector<uint8_t> changedLeaves;
+        for (size_t n = 0; n < count; n += 1 + count / 4)
+        {
+            chunks[n] += " changed";
+            Merkle::Digest leaf = Merkle::HashLeaf(chunks[n]);
+            changed.push_back(n);
+            changedLeaves.insert(changedLeaves.end(), leaf.begin(), leaf.end());
+        }
+        parallel.UpdateLeaves(changed.data(), changedLeaves.data(), changed.size());
+        for (size_t n = 0; n < changed.size(); n++)
+        {
+            sequential.UpdateLeaf(changed[n], changedLeaves.data() + n * Merkle::DigestSize);
+        }
+        expected = Sha2Cpp::ToHex(merkleReference(chunks, 0, count));
+        is_pass = is_pass && Sha2Cpp::ToHex(parallel.Root()) == expected && sequential.Root() == parallel.Root();
+
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Merkle tree of " << count << " leaves" << Clear
+                  << std::endl;
+        std::cout << "expected root:   " << FgYellow << expected << Clear << std::endl;
+        std::cout << "calculated root: " << FgMagenta << Sha2Cpp::ToHex(parallel.Root()) << Clear << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- HMAC tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases_HMAC)
+    {
+        std::vector<uint8_t> hash = testInstances.HMAC(test.type, test.str, test.key);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
+        std::cout << "original string: " << FgCyan << test.str << Clear << std::endl;
+        std::cout << "key string: " << FgCyan << test.key << Clear << std::endl;
+        std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    std::cout << BgWhite << FgBlack << "---------------- RFC 4231 HMAC tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto const &test : testCases_RFC4231)
+    {
+        std::vector<uint8_t> hash = testInstances.HMAC(test.type, hex2string(test.str), hex2string(test.key));
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
+        std::cout << "data (hex):      " << FgCyan << test.str << Clear << std::endl;
+        std::cout << "key (hex):       " << FgCyan << test.key << Clear << std::endl;
+        std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(0, test.sample.size(), test.sample) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+#ifdef WITH_SHA256
+    std::cout << BgWhite << FgBlack << "---------------- HMAC key reuse tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto const &test : testCases_HMAC)
+    {
+        if (test.type != Sha2Cpp::HashType::Sha256)
+        {
+            continue;
+        }
+
+        Sha2Cpp::HmacKey<Sha2Cpp::HashType::Sha256> key(test.key);
+        for (size_t n = 0; n < 3; n++)
+        {
+            std::vector<uint8_t> hash = key.Mac(test.str);
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " with a prepared key, pass " << n
+                      << Clear << std::endl;
+            std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+            bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+#endif
+
+#ifdef WITH_SHA256
+    std::cout << BgWhite << FgBlack << "---------------- Streaming HMAC tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto const &test : testCases_HMAC)
+    {
+        if (test.type != Sha2Cpp::HashType::Sha256)
+        {
+            continue;
+        }
+
+        Sha2Cpp::Hmac<Sha2Cpp::HashType::Sha256> hmac(test.key);
+        for (size_t chunk : {1, 13, 64, 1000})
+        {
+            for (size_t pos = 0; pos < test.str.size(); pos += chunk)
+            {
+                hmac.Update(test.str.data() + pos, std::min(chunk, test.str.size() - pos));
+            }
+            std::vector<uint8_t> hash = hmac.Final();
+
+            for (size_t pos = 0; pos < test.str.size(); pos += chunk)
+            {
+                hmac.Update(test.str.data() + pos, std::min(chunk, test.str.size() - pos));
+            }
+            bool verified = hmac.Verify(hash);
+            hmac.Update(test.str);
+            hash[0] ^= 1;
+            bool rejected = !hmac.Verify(hash);
+            hash[0] ^= 1;
+
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " in chunks of " << chunk << Clear
+                      << std::endl;
+            std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+            bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0) && verified && rejected;
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- PBKDF2 tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases_PBKDF2)
+    {
+        std::vector<uint8_t> hash =
+            testInstances.PBKDF2(test.type, test.password, test.salt, test.iterations, test.sample.size() / 2);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
+        std::cout << "expected key:    " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated key:  " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    std::cout << BgWhite << FgBlack << "---------------- HKDF tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases_HKDF)
+    {
+        std::vector<uint8_t> hash = testInstances.HKDF(test.type, hex2string(test.salt), hex2string(test.ikm),
+                                                       hex2string(test.info), test.okm.size() / 2);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
+        std::cout << "expected key:    " << FgYellow << test.prk << test.okm << Clear << std::endl;
+        std::cout << "calculated key:  " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.prk + test.okm) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+#ifdef SHA2CPP_CONSTEXPR_HASH
+#ifdef WITH_SHA256
+    // evaluated by the compiler, a wrong digest fails the build
+    static constexpr auto abcDigest = Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256>::ConstexprHash("abc");
+    static_assert(abcDigest[0] == 0xba && abcDigest[1] == 0x78 && abcDigest[31] == 0xad, "constexpr Sha256");
+#endif
+    std::cout << BgWhite << FgBlack << "---------------- Constexpr tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases)
+    {
+        std::vector<uint8_t> hash = testInstances.ConstexprHash(test.type, test.str);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << Clear << std::endl;
+        std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+        std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+        bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- Exported state tests ----------------" << Clear << "\n"
+              << std::endl;
+    for (auto const &test : testCases)
+    {
+        for (size_t split : {size_t(0), std::min<size_t>(1, test.str.size()), test.str.size() / 2, test.str.size()})
+        {
+            std::vector<uint8_t> hash = testInstances.HashResumed(test.type, test.str, split);
+            std::cout << (++i) << ". Executing test:  " << FgBlue << test.name << " resumed at " << split << Clear
+                      << std::endl;
+            std::cout << "expected hash:   " << FgYellow << test.sample << Clear << std::endl;
+            std::cout << "calculated hash: " << FgMagenta << Sha2Cpp::ToHex(hash) << Clear << std::endl;
+            bool is_pass = (Sha2Cpp::ToHex(hash).compare(test.sample) == 0);
+            std::cout << "result: "
+                      << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed"))
+                      << Clear << std::endl;
+            std::cout << std::endl;
+        }
+    }
+
+#ifdef WITH_SHA256
+    {
+        // a state one block short of the 2^61 byte limit, resumed from an export
+        typedef Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> Sha256;
+        std::vector<uint8_t> saved = Sha256().Export();
+        uint64_t length = (uint64_t(1) << 61) - 64;
+        for (size_t n = 0; n < sizeof(uint64_t); n++)
+        {
+            saved[1 + n] = static_cast<uint8_t>(length >> (56 - 8 * n));
+        }
+        Sha256 hasher;
+        bool is_pass = hasher.Import(saved);
+        hasher.Update(std::string(63, 'a'));
+        try
+        {
+            hasher.Update("a");
+            is_pass = false;
+        }
+        catch (const std::length_error &)
+        {
+        }
+        std::vector<uint8_t> tooLong = saved;
+        tooLong[1] = 0x20;
+        is_pass = is_pass && hasher.Final().size() == Sha256::DigestSize && !Sha256().Import(tooLong);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Sha256 message longer than 2^61 - 1 bytes" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+#if defined(WITH_SHA256) && defined(WITH_SHA224)
+    {
+        Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha256> hasher;
+        hasher.Update("some prefix");
+        std::vector<uint8_t> saved = hasher.Export();
+        std::vector<uint8_t> truncated(saved.begin(), saved.end() - 1);
+        Sha2Cpp::Sha2<Sha2Cpp::HashType::Sha224> other;
+        bool is_pass = !hasher.Import(truncated) && !other.Import(saved) && hasher.Import(saved);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Malformed and foreign exported states" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+#endif
+
+    std::cout << BgWhite << FgBlack << "---------------- Encoding tests ----------------" << Clear << "\n" << std::endl;
+    for (auto const &test : testCases_Encoding)
+    {
+        std::string hex = Sha2Cpp::ToHex(test.data);
+        std::string base64 = Sha2Cpp::ToBase64(test.data);
+        std::string base64url = Sha2Cpp::ToBase64(test.data, Sha2Cpp::Base64Alphabet::Url);
+        std::vector<uint8_t> bytes(test.data.begin(), test.data.end());
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Encoding of \"" << hex << "\"" << Clear << std::endl;
+        std::cout << "expected:   " << FgYellow << test.hex << " " << test.base64 << " " << test.base64url << Clear
+                  << std::endl;
+        std::cout << "calculated: " << FgMagenta << hex << " " << base64 << " " << base64url << Clear << std::endl;
+        bool is_pass = hex == test.hex && base64 == test.base64 && base64url == test.base64url
+                       && Sha2Cpp::FromHex(test.hex) == bytes && Sha2Cpp::FromBase64(test.base64) == bytes
+                       && Sha2Cpp::FromBase64(test.base64url, Sha2Cpp::Base64Alphabet::Url) == bytes;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    {
+        // the vector path of the hex encoder against the lookup table for every length and byte value
+        std::vector<uint8_t> bytes(300);
+        for (size_t n = 0; n < bytes.size(); n++)
+        {
+            bytes[n] = static_cast<uint8_t>(n * 37 + 11);
+        }
+        bool is_pass = true;
+        for (size_t length = 0; length <= bytes.size(); length++)
+        {
+            std::string hex = Sha2Cpp::ToHex(Sha2Cpp::ByteView(bytes.data(), length));
+            for (size_t n = 0; n < length; n++)
+            {
+                is_pass = is_pass && hex[2 * n] == "0123456789abcdef"[bytes[n] >> 4]
+                          && hex[2 * n + 1] == "0123456789abcdef"[bytes[n] & 0x0f];
+            }
+            std::string upper = hex;
+            std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+            is_pass = is_pass && Sha2Cpp::FromHex(upper) == std::vector<uint8_t>(bytes.begin(), bytes.begin() + length);
+            is_pass = is_pass
+                      && Sha2Cpp::FromBase64(Sha2Cpp::ToBase64(Sha2Cpp::ByteView(bytes.data(), length)))
+                             == std::vector<uint8_t>(bytes.begin(), bytes.begin() + length);
+        }
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Hex and Base64 round trips of 0 to 300 bytes" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    for (const char *malformed : {"abc", "0g", "zz00", "0x12"})
+    {
+        bool is_pass = Sha2Cpp::FromHex(malformed).empty();
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Malformed hex \"" << malformed << "\"" << Clear
+                  << std::endl;
+        std::cout << "result: "
+                  << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
+                  << std::endl;
+        std::cout << std::endl;
+    }
+
+    for (const char *malformed : {"Zg=", "Zg=a", "Z===", "Zh==", "Zm9=", "Zm+v_w==", "Zg==Zg=="})
+    {
+        uint8_t out[16];
+        size_t length = 0;
+        bool is_pass = !Sha2Cpp::Base64Decode(malformed, out, length)
+                       && !Sha2Cpp::Base64Decode(malformed, out, length, Sha2Cpp::Base64Alphabet::Url);
+        std::cout << (++i) << ". Executing test:  " << FgBlue << "Malformed Base64 \"" << malformed << "\"" << Clear
+                  << std::endl;
         std::cout << "result: "
                   << (is_pass ? (std::string(FgGreen) + "passed") : (failed++, std::string(FgRed) + "failed")) << Clear
                   << std::endl;